@@ -0,0 +1,259 @@
+#include "batch.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+
+#ifdef __linux__
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#include <lua.hpp>
+#include "luaenv/lua.hh"
+#include "luaenv/modules.hh"
+#include "render/canvas.hh"
+#include "render/canvas_lua.hh"
+#include "sim/simulation.hh"
+#include "sim/simulation_lua.hh"
+#include "sim/switch_sim.hh"
+#include "sim/switch_sim_lua.hh"
+#include "sim/wave_recorder.hh"
+#include "sim/wave_recorder_lua.hh"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+//
+// WORKERS
+//
+
+// Pins the calling thread to the n-th core it's allowed to run on (wrapping around), so that workers don't
+// migrate between cores and share their caches. Elsewhere, the scheduler decides.
+static void pin_thread(size_t n)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+
+    size_t target = n % (size_t) CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+            return;
+        }
+    }
+#endif
+}
+
+BatchRun::BatchRun(BatchOptions const& options, std::ostream& out)
+    : out_(out), modules_(options.modules), check_(options.check), start_(Clock::now())
+{
+    size_t n = options.workers ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    capacity_ = options.queue ? options.queue : 4 * n;
+    summary_.workers = n;
+
+    for (size_t i = 0; i < n; ++i) {
+        workers_.emplace_back([this, i, affinity = options.affinity] {
+            if (affinity)
+                pin_thread(i);
+            worker(i);
+        });
+    }
+}
+
+BatchRun::~BatchRun()
+{
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    not_empty_.notify_all();
+    for (std::thread& t : workers_)
+        if (t.joinable())
+            t.join();
+}
+
+void BatchRun::add(Job job)
+{
+    std::unique_lock lock(mutex_);
+    if (closed_)
+        throw std::logic_error("The batch run is already finished");
+    not_full_.wait(lock, [this] { return queue_.size() < capacity_; });
+    queue_.push_back({ next_id_++, std::move(job) });
+    not_empty_.notify_one();
+}
+
+BatchRun::Summary BatchRun::finish()
+{
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    not_empty_.notify_all();
+    for (std::thread& t : workers_)
+        if (t.joinable())
+            t.join();
+
+    std::lock_guard lock(out_mutex_);
+    summary_.wall_ms = ms_since(start_);
+
+    char buf[256];
+    snprintf(buf, sizeof buf, R"({"summary":true,"jobs":%zu,"passed":%zu,"failed":%zu,"workers":%zu,"wall_ms":%.2f,"cpu_ms":%.2f})",
+             summary_.jobs, summary_.passed, summary_.failed, summary_.workers, summary_.wall_ms, summary_.cpu_ms);
+    out_ << buf << std::endl;
+    return summary_;
+}
+
+void BatchRun::worker(size_t index)
+{
+    for (;;) {
+        Queued queued;
+        {
+            std::unique_lock lock(mutex_);
+            not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            queued = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        not_full_.notify_one();
+
+        report(queued, run(index, queued));
+    }
+}
+
+//
+// JOBS
+//
+
+// Runs a script file in L, returning false if it returned false (any other result, or none, is a pass).
+// Errors carry the Lua traceback.
+static bool run_script(lua_State* L, std::string const& path)
+{
+    if (luaL_loadfile(L, path.c_str()) != 0) {
+        std::string msg = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw std::runtime_error(msg);
+    }
+    std::string undeclared = luaw_check_globals(L, -1);
+    if (!undeclared.empty()) {
+        lua_pop(L, 1);
+        throw std::runtime_error(undeclared);
+    }
+    luaw_call_push(L, 1);
+    bool passed = !(lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+    lua_pop(L, 1);
+    return passed;
+}
+
+BatchRun::Result BatchRun::run(size_t index, Queued const& queued) const
+{
+    Result r;
+    r.worker = index;
+    Clock::time_point start = Clock::now();
+
+    try {
+        // the same globals as WEngine; the Lua state is declared last so it's closed before what it refers to
+        Simulation    simulation;
+        SwitchNetwork switches;
+        WaveRecorder  recorder { simulation.netlist };
+        Canvas        canvas;
+        Lua           lua { check_, LUAW_LIBS_ALL, true };
+
+        simulation.set_threads(1);   // the cores are already taken by the other workers
+        simulation.set_recorder(&recorder);
+
+        lua.with_lua([&](lua_State* L) {
+            if (modules_)
+                modules_->install(L);
+            simulation_lua_install(L, &simulation);
+            switch_sim_lua_install(L, &switches);
+            wave_recorder_lua_install(L, &recorder);
+            canvas_lua_install(L, &canvas);
+            r.setup_ms = ms_since(start);
+
+            Clock::time_point t = Clock::now();
+            r.passed = run_script(L, queued.job.circuit);
+            r.circuit_ms = ms_since(t);
+            if (!r.passed)
+                r.error = "The circuit script returned false";
+
+            if (r.passed && !queued.job.testbench.empty()) {
+                t = Clock::now();
+                r.passed = run_script(L, queued.job.testbench);
+                r.testbench_ms = ms_since(t);
+                if (!r.passed)
+                    r.error = "The testbench returned false";
+            }
+        });
+
+        r.ticks = simulation.tick();
+        r.wires = simulation.netlist.wire_count();
+        r.gates = simulation.netlist.gate_count();
+    } catch (std::exception& e) {
+        r.passed = false;
+        r.error = e.what();
+    }
+
+    r.total_ms = ms_since(start);
+    return r;
+}
+
+//
+// RESULTS
+//
+
+static std::string json_string(std::string const& s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof buf, "\\u%04x", (unsigned) c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+void BatchRun::report(Queued const& queued, Result const& r)
+{
+    std::string line = "{\"job\":" + std::to_string(queued.id)
+                     + ",\"circuit\":" + json_string(queued.job.circuit)
+                     + ",\"testbench\":" + json_string(queued.job.testbench)
+                     + ",\"status\":" + (r.passed ? "\"pass\"" : "\"fail\"");
+    if (!r.passed)
+        line += ",\"error\":" + json_string(r.error);
+
+    char buf[256];
+    snprintf(buf, sizeof buf, R"(,"worker":%zu,"ticks":%llu,"wires":%zu,"gates":%zu,"setup_ms":%.2f,"circuit_ms":%.2f,"testbench_ms":%.2f,"total_ms":%.2f})",
+             r.worker, (unsigned long long) r.ticks, r.wires, r.gates, r.setup_ms, r.circuit_ms, r.testbench_ms, r.total_ms);
+    line += buf;
+
+    std::lock_guard lock(out_mutex_);
+    out_ << line << std::endl;   // flushed, so the results of a long run can be followed
+    ++summary_.jobs;
+    ++(r.passed ? summary_.passed : summary_.failed);
+    summary_.cpu_ms += r.total_ms;
+}
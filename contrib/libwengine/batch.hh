@@ -0,0 +1,108 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "luaw/luaw.hh"
+
+class ModuleIndex;
+
+//
+// Headless batch runs, for regressions over many designs: no window is opened, and the jobs run in parallel
+// on a pool of worker threads, each one pinned to its own core (on Linux). Every job gets a fresh Lua state
+// and simulation, with the same globals as the interactive engine except for the scheduler, runs the circuit
+// script and then the testbench script (if any) in it, and passes if neither raised an error and the
+// testbench didn't return false.
+//
+// Jobs are handed to the workers through a bounded queue, so `add` blocks while the workers are behind,
+// and a job list of any size is read as it's consumed. A result is written as soon as its job finishes, as
+// one JSON object per line (so in completion order, identified by `job`):
+//
+//   {"job":1,"circuit":"a.lua","testbench":"a_tb.lua","status":"pass","worker":0,"ticks":100,"wires":12,
+//    "gates":9,"setup_ms":0.41,"circuit_ms":1.20,"testbench_ms":3.52,"total_ms":5.13}
+//   {"job":2,"circuit":"b.lua","testbench":"","status":"fail","error":"...",...}
+//
+// followed by a summary line from `finish`:
+//
+//   {"summary":true,"jobs":2,"passed":1,"failed":1,"workers":2,"wall_ms":5.40,"cpu_ms":9.87}
+//
+
+struct BatchOptions {
+    size_t       workers = 0;        // 0 = one per core
+    size_t       queue = 0;          // jobs waiting to be picked up by a worker, 0 = 4 per worker
+    bool         affinity = true;    // pin each worker to a core
+    ModuleIndex* modules = nullptr;  // what `require` finds, shared by the jobs (see modules.hh)
+    LuawCheck    check = LUAW_DEFAULT_CHECK;   // of the scripts (see luaw.hh)
+};
+
+class BatchRun {
+public:
+    struct Job {
+        std::string circuit;
+        std::string testbench;   // optional
+    };
+
+    struct Summary {
+        size_t jobs = 0;
+        size_t passed = 0;
+        size_t failed = 0;
+        size_t workers = 0;
+        double wall_ms = 0;
+        double cpu_ms = 0;       // sum of the jobs' total times
+    };
+
+    BatchRun(BatchOptions const& options, std::ostream& out);
+    BatchRun(BatchRun const&) = delete;
+    BatchRun& operator=(BatchRun const&) = delete;
+    ~BatchRun();
+
+    void    add(Job job);   // blocks while the queue is full
+    Summary finish();       // waits for every job, and writes the summary
+
+private:
+    struct Result {
+        size_t      worker;
+        bool        passed = false;
+        std::string error;
+        uint64_t    ticks = 0;
+        size_t      wires = 0;
+        size_t      gates = 0;
+        double      setup_ms = 0, circuit_ms = 0, testbench_ms = 0, total_ms = 0;
+    };
+
+    struct Queued {
+        size_t id = 0;
+        Job    job;
+    };
+
+    void   worker(size_t index);
+    Result run(size_t index, Queued const& queued) const;
+    void   report(Queued const& queued, Result const& result);
+
+    std::ostream&            out_;
+    ModuleIndex*             modules_;
+    LuawCheck                check_;
+    std::vector<std::thread> workers_;
+    size_t                   capacity_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::mutex               mutex_;        // guards the queue
+    std::condition_variable  not_empty_;
+    std::condition_variable  not_full_;
+    std::deque<Queued>       queue_;
+    size_t                   next_id_ = 1;
+    bool                     closed_ = false;
+
+    std::mutex               out_mutex_;    // guards the output and the summary
+    Summary                  summary_;
+};
+
+#endif //BATCH_HH
@@ -0,0 +1,260 @@
+#ifndef SPATIAL_GRID_HH
+#define SPATIAL_GRID_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <queue>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct Rect {
+    float x = 0, y = 0, w = 0, h = 0;
+
+    float right() const  { return x + w; }
+    float bottom() const { return y + h; }
+    bool  intersects(Rect const& o) const { return x <= o.right() && o.x <= right() && y <= o.bottom() && o.y <= bottom(); }
+};
+
+//
+// Uniform grid over an unbounded plane, for items with a bounding box. Only cells that hold something exist
+// (in a hash map), so far-apart items cost nothing. An item is stored in every cell its box overlaps; each
+// cell also carries a dirty flag, set whenever its contents change, for caches built per cell.
+//
+// Range queries visit only the cells overlapping the range; nearest-neighbour queries walk rings of cells
+// outward from the point, and stop once no cell further out can hold anything closer than what was found.
+//
+
+template <typename T>
+class SpatialGrid {
+public:
+    struct Entry {
+        T    item;
+        Rect bounds;
+    };
+
+    struct Cell {
+        std::vector<Entry> entries;
+        bool               dirty = true;
+    };
+
+    using CellKey = uint64_t;
+
+    explicit SpatialGrid(float cell_size) : cell_size_(cell_size) {}
+
+    float cell_size() const { return cell_size_; }
+    size_t size() const     { return size_; }
+
+    void insert(T item, Rect const& bounds) {
+        for_each_cell_key(bounds, [&](CellKey key) {
+            Cell& cell = cells_[key];
+            cell.entries.push_back({ item, bounds });
+            cell.dirty = true;
+        });
+        grow_extent(bounds);
+        ++size_;
+    }
+
+    // inserts many items at once, sizing every cell before filling it
+    void insert(std::span<Entry const> entries) {
+        std::unordered_map<CellKey, uint32_t> counts;
+        for (Entry const& e : entries)
+            for_each_cell_key(e.bounds, [&](CellKey key) { ++counts[key]; });
+        cells_.reserve(cells_.size() + counts.size());
+        for (auto const& [key, n] : counts) {
+            Cell& cell = cells_[key];
+            cell.entries.reserve(cell.entries.size() + n);
+            cell.dirty = true;
+        }
+        for (Entry const& e : entries) {
+            for_each_cell_key(e.bounds, [&](CellKey key) { cells_[key].entries.push_back(e); });
+            grow_extent(e.bounds);
+        }
+        size_ += entries.size();
+    }
+
+    // `bounds` must be the ones the item was inserted with
+    bool remove(T item, Rect const& bounds) {
+        bool found = false;
+        for_each_cell_key(bounds, [&](CellKey key) {
+            auto it = cells_.find(key);
+            if (it == cells_.end())
+                return;
+            auto& entries = it->second.entries;
+            auto e = std::find_if(entries.begin(), entries.end(), [&](Entry const& en) { return en.item == item; });
+            if (e != entries.end()) {
+                *e = entries.back();
+                entries.pop_back();
+                it->second.dirty = true;
+                found = true;
+                if (entries.empty())
+                    cells_.erase(it);
+            }
+        });
+        if (found)
+            --size_;
+        return found;
+    }
+
+    void clear() { cells_.clear(); size_ = 0; extent_ = {}; }
+
+    // calls f(item, bounds) once for every item whose box intersects `area`
+    template <typename F>
+    void query(Rect const& area, F f) const {
+        for_each_existing_cell(area, [&](CellKey key, Cell const& cell) {
+            for (Entry const& e : cell.entries) {
+                if (!e.bounds.intersects(area))
+                    continue;
+                // an item spanning several cells is reported only by the cell holding the top-left corner of its overlap with `area`
+                if (cell_key(std::max(e.bounds.x, area.x), std::max(e.bounds.y, area.y)) == key)
+                    f(e.item, e.bounds);
+            }
+        });
+    }
+
+    // Calls f(item, distance) for the (at most) `k` nearest items to (x, y), nearest first. `distance(item, bounds)`
+    // gives the distance from the point to an item, at least the distance to its bounds (returning infinity
+    // skips the item).
+    template <typename D, typename F>
+    void nearest(float x, float y, size_t k, D distance, F f) const {
+        if (k == 0 || cells_.empty())
+            return;
+
+        using Found = std::pair<float, T>;
+        std::priority_queue<Found> best;   // the k nearest so far, furthest on top
+        std::unordered_set<T>      seen;   // items spanning several cells
+        auto consider = [&](Cell const& cell) {
+            for (Entry const& e : cell.entries) {
+                if (cell_key(e.bounds.x, e.bounds.y) != cell_key(e.bounds.right(), e.bounds.bottom()) && !seen.insert(e.item).second)
+                    continue;
+                float d = distance(e.item, e.bounds);
+                if (d == std::numeric_limits<float>::infinity())
+                    continue;
+                if (best.size() < k) {
+                    best.emplace(d, e.item);
+                } else if (d < best.top().first) {
+                    best.pop();
+                    best.emplace(d, e.item);
+                }
+            }
+        };
+
+        int32_t px = coord(x), py = coord(y);
+        int32_t max_ring = std::max({ px - extent_.x0, extent_.x1 - px, py - extent_.y0, extent_.y1 - py, 0 });
+        for (int32_t r = 0; r <= max_ring; ++r) {
+            if ((uint64_t) r * 8 > cells_.size()) {
+                // the ring has more cells than the grid: visit the remaining cells directly
+                for (auto const& [key, cell] : cells_) {
+                    auto [cx, cy] = cell_coords(key);
+                    if (std::max(std::abs(cx - px), std::abs(cy - py)) >= r)
+                        consider(cell);
+                }
+                break;
+            }
+            for_each_ring_cell(px, py, r, [&](CellKey key) {
+                auto it = cells_.find(key);
+                if (it != cells_.end())
+                    consider(it->second);
+            });
+            // anything outside rings 0..r is at least r cells away
+            if (best.size() == k && best.top().first <= (float) r * cell_size_)
+                break;
+        }
+
+        std::vector<Found> found(best.size());
+        for (size_t i = found.size(); i-- > 0; best.pop())
+            found[i] = best.top();
+        for (auto const& [d, item] : found)
+            f(item, d);
+    }
+
+    // cells
+
+    Rect cell_bounds(CellKey key) const {
+        auto [cx, cy] = cell_coords(key);
+        return { (float) cx * cell_size_, (float) cy * cell_size_, cell_size_, cell_size_ };
+    }
+
+    template <typename F>
+    void for_each_existing_cell(Rect const& area, F f) const {
+        int32_t x0 = coord(area.x), y0 = coord(area.y), x1 = coord(area.right()), y1 = coord(area.bottom());
+        if ((uint64_t) (x1 - x0 + 1) * (uint64_t) (y1 - y0 + 1) > cells_.size()) {
+            for (auto const& [key, cell] : cells_) {   // sparser than the area: walk the cells instead
+                auto [cx, cy] = cell_coords(key);
+                if (cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1)
+                    f(key, cell);
+            }
+        } else {
+            for (int32_t cy = y0; cy <= y1; ++cy) {
+                for (int32_t cx = x0; cx <= x1; ++cx) {
+                    auto it = cells_.find(make_key(cx, cy));
+                    if (it != cells_.end())
+                        f(it->first, it->second);
+                }
+            }
+        }
+    }
+
+    Cell*       find_cell(CellKey key)       { auto it = cells_.find(key); return it == cells_.end() ? nullptr : &it->second; }
+    Cell const* find_cell(CellKey key) const { auto it = cells_.find(key); return it == cells_.end() ? nullptr : &it->second; }
+
+    void mark_dirty(Rect const& area) {
+        for_each_cell_key(area, [&](CellKey key) {
+            auto it = cells_.find(key);
+            if (it != cells_.end())
+                it->second.dirty = true;
+        });
+    }
+
+    CellKey cell_key(float x, float y) const { return make_key(coord(x), coord(y)); }
+
+private:
+    int32_t coord(float v) const { return (int32_t) std::floor(v / cell_size_); }
+
+    static CellKey make_key(int32_t cx, int32_t cy) { return (uint64_t) (uint32_t) cx << 32 | (uint32_t) cy; }
+    static std::pair<int32_t, int32_t> cell_coords(CellKey key) { return { (int32_t) (uint32_t) (key >> 32), (int32_t) (uint32_t) key }; }
+
+    template <typename F>
+    static void for_each_ring_cell(int32_t px, int32_t py, int32_t r, F f) {
+        if (r == 0) {
+            f(make_key(px, py));
+            return;
+        }
+        for (int32_t cx = px - r; cx <= px + r; ++cx) {
+            f(make_key(cx, py - r));
+            f(make_key(cx, py + r));
+        }
+        for (int32_t cy = py - r + 1; cy <= py + r - 1; ++cy) {
+            f(make_key(px - r, cy));
+            f(make_key(px + r, cy));
+        }
+    }
+
+    void grow_extent(Rect const& r) {
+        Extent e { coord(r.x), coord(r.y), coord(r.right()), coord(r.bottom()), false };
+        if (!extent_.empty)
+            e = { std::min(extent_.x0, e.x0), std::min(extent_.y0, e.y0), std::max(extent_.x1, e.x1), std::max(extent_.y1, e.y1), false };
+        extent_ = e;
+    }
+
+    template <typename F>
+    void for_each_cell_key(Rect const& r, F f) const {
+        for (int32_t cy = coord(r.y); cy <= coord(r.bottom()); ++cy)
+            for (int32_t cx = coord(r.x); cx <= coord(r.right()); ++cx)
+                f(make_key(cx, cy));
+    }
+
+    struct Extent { int32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0; bool empty = true; };
+
+    float                             cell_size_;
+    std::unordered_map<CellKey, Cell> cells_;
+    size_t                            size_ = 0;
+    Extent                            extent_;   // of every cell ever used (only grows, until cleared)
+};
+
+#endif //SPATIAL_GRID_HH
@@ -7,7 +7,9 @@
 
 class Lua {
 public:
-    Lua() : L(luaw_newstate(false)) {}
+    // the globals aren't checked unless asked for, as scripts typed at the console create them freely
+    explicit Lua(LuawCheck check=LUAW_DEFAULT_CHECK, unsigned libs=LUAW_LIBS_ALL, bool strict=false)
+        : L(luaw_newstate(check, libs, strict)) {}
     ~Lua() { lua_close(L); }
 
     template <typename T=void, typename F, typename... Args>
@@ -0,0 +1,236 @@
+#include "modules.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "luaw/luaw.hh"
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t ns_since(Clock::time_point t)
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count();
+}
+
+//
+// INDEX
+//
+
+void ModuleIndex::add(std::string const& name, uint8_t const* data, size_t size)
+{
+    Module m;
+    m.data = data;
+    m.size = size;
+    modules_.insert_or_assign(name, std::move(m));
+}
+
+void ModuleIndex::add_file(std::string const& name, std::string const& path)
+{
+    Module m;
+    m.path = path;
+    modules_.insert_or_assign(name, std::move(m));
+}
+
+size_t ModuleIndex::add_directory(std::string const& path)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(path, ec);
+    if (ec)
+        throw std::runtime_error("Could not open directory '" + path + "': " + ec.message());
+
+    size_t n = 0;
+    for (fs::directory_entry const& entry : it) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".lua")
+            continue;
+
+        fs::path module = entry.path().lexically_relative(path).replace_extension();
+        if (module.filename() == "init")
+            module = module.parent_path();
+        std::string name = module.generic_string();
+        if (name.empty())
+            continue;
+        std::replace(name.begin(), name.end(), '/', '.');
+
+        add_file(name, entry.path().string());
+        ++n;
+    }
+    return n;
+}
+
+std::vector<ModuleIndex::Stats> ModuleIndex::stats() const
+{
+    std::vector<Stats> stats;
+    {
+        std::lock_guard lock(mutex_);
+        for (auto const& [name, m] : modules_) {
+            std::error_code ec;
+            size_t bytes = m.path.empty() ? m.size : (size_t) std::filesystem::file_size(m.path, ec);
+            stats.push_back({ name, m.path.empty() ? "embedded" : m.path, ec ? 0 : bytes, m.loads, m.compile_ns, m.run_ns });
+        }
+    }
+    std::sort(stats.begin(), stats.end(), [](Stats const& a, Stats const& b) { return a.name < b.name; });
+    return stats;
+}
+
+//
+// LOADING
+//
+
+void ModuleIndex::install(lua_State* L)
+{
+    luaw_getglobal(L, "package");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        throw std::logic_error("The module index needs the package library");
+    }
+
+#if LUAW == JIT
+    lua_getfield(L, -1, "loaders");
+#else
+    lua_getfield(L, -1, "searchers");
+#endif
+    // make room after package.preload's searcher
+    for (int i = luaw_len(L, -1); i >= 2; --i) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, lua_searcher, 1);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 1);
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, lua_modules, 1);
+    lua_setfield(L, -2, "modules");
+    lua_pop(L, 1);
+}
+
+static int write_chunk(lua_State*, void const* p, size_t sz, void* ud)
+{
+    static_cast<std::string *>(ud)->append(static_cast<char const *>(p), sz);
+    return 0;
+}
+
+// Leaves the loader of the module on the stack, or the reason it's not found (as searchers do).
+int ModuleIndex::search(lua_State* L, std::string const& name)
+{
+    auto it = modules_.find(name);
+    if (it == modules_.end()) {
+        lua_pushfstring(L, "\n\tno module '%s' in the module index", name.c_str());
+        return 1;
+    }
+    Module& m = it->second;
+
+    std::shared_ptr<std::string const> bytecode;
+    {
+        std::lock_guard lock(mutex_);
+        bytecode = m.bytecode;
+    }
+
+    std::string source;
+    char const* chunk;
+    size_t      size;
+    if (bytecode) {
+        chunk = bytecode->data();
+        size = bytecode->size();
+    } else if (m.path.empty()) {
+        chunk = (char const *) m.data;
+        size = m.size;
+    } else {
+        std::ifstream f(m.path, std::ios::binary);
+        if (!f.good())
+            throw std::runtime_error("Could not open file '" + m.path + "'");
+        std::stringstream buffer;
+        buffer << f.rdbuf();
+        source = buffer.str();
+        chunk = source.data();
+        size = source.size();
+    }
+
+    Clock::time_point start = Clock::now();
+    std::string chunk_name = m.path.empty() ? "=" + name : "@" + m.path;
+    if (luaL_loadbuffer(L, chunk, size, chunk_name.c_str()) != 0) {
+        std::string msg = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw std::runtime_error("Error loading module '" + name + "': " + msg);
+    }
+    std::string undeclared = luaw_check_globals(L, -1);
+    if (!undeclared.empty()) {
+        lua_pop(L, 1);
+        throw std::runtime_error("Error loading module '" + name + "': " + undeclared);
+    }
+
+    // the first state to compile the source keeps the bytecode for the others
+    std::shared_ptr<std::string> dumped;
+    if (!bytecode && (size == 0 || chunk[0] != '\x1b')) {
+        dumped = std::make_shared<std::string>();
+#if LUAW == JIT
+        lua_dump(L, write_chunk, dumped.get());
+#else
+        lua_dump(L, write_chunk, dumped.get(), 0);
+#endif
+    }
+    uint64_t compile_ns = ns_since(start);
+
+    {
+        std::lock_guard lock(mutex_);
+        if (dumped && !m.bytecode)
+            m.bytecode = std::move(dumped);
+        ++m.loads;
+        m.compile_ns += compile_ns;
+    }
+
+    lua_pushlightuserdata(L, &m);
+    lua_insert(L, -2);
+    lua_pushlightuserdata(L, this);
+    lua_insert(L, -3);
+    lua_pushcclosure(L, lua_loader, 3);
+    return 1;
+}
+
+int ModuleIndex::lua_searcher(lua_State* L)
+{
+    ModuleIndex* index = (ModuleIndex *) lua_touserdata(L, lua_upvalueindex(1));
+    std::string name = luaL_checkstring(L, 1);
+    return luaw_protect(L, [&] { return index->search(L, name); });
+}
+
+// upvalues: the index, the module and its compiled chunk; called by require with the module name
+int ModuleIndex::lua_loader(lua_State* L)
+{
+    ModuleIndex* index = (ModuleIndex *) lua_touserdata(L, lua_upvalueindex(1));
+    Module* m = (Module *) lua_touserdata(L, lua_upvalueindex(2));
+
+    lua_pushvalue(L, lua_upvalueindex(3));
+    lua_insert(L, 1);
+    Clock::time_point start = Clock::now();
+    lua_call(L, lua_gettop(L) - 1, 1);
+    uint64_t run_ns = ns_since(start);
+
+    std::lock_guard lock(index->mutex_);
+    m->run_ns += run_ns;
+    return 1;
+}
+
+int ModuleIndex::lua_modules(lua_State* L)
+{
+    ModuleIndex* index = (ModuleIndex *) lua_touserdata(L, lua_upvalueindex(1));
+
+    lua_newtable(L);
+    for (Stats const& s : index->stats()) {
+        lua_newtable(L);
+        luaw_setfield(L, -1, "origin", s.origin);
+        luaw_setfield(L, -1, "bytes", s.bytes);
+        luaw_setfield(L, -1, "loads", s.loads);
+        luaw_setfield(L, -1, "compile_ms", (double) s.compile_ns / 1e6);
+        luaw_setfield(L, -1, "run_ms", (double) s.run_ns / 1e6);
+        lua_setfield(L, -2, s.name.c_str());
+    }
+    return 1;
+}
@@ -0,0 +1,75 @@
+#ifndef MODULES_HH
+#define MODULES_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lua.hpp>
+
+//
+// Index of the Lua modules that `require` can find, either embedded in the binary (the generated .lua.h
+// arrays, as source or bytecode) or files in a directory, found by name without being read. The index is
+// built once and then shared by every Lua state: `install` puts a searcher for it in a state's package
+// searchers (package.loaders in LuaJIT), right after package.preload, so a module is only read and compiled
+// the first time a state requires it, and what no script requires costs nothing. The first compile of a
+// module's source is kept as bytecode, so the other states (the shards, the batch workers) load it without
+// parsing it again.
+//
+// Loading times are recorded per module, over every state, and are also available from Lua:
+//
+//   package.modules() -> { [name] = { origin=, bytes=, loads=, compile_ms=, run_ms= } }
+//
+// where run_ms includes the modules it requires in turn. Modules must be added before the states that use
+// the index run any script; a module added again replaces the previous one (so a directory can override
+// what's embedded).
+//
+
+class ModuleIndex {
+public:
+    struct Stats {
+        std::string name;
+        std::string origin;          // the file, or "embedded"
+        size_t      bytes = 0;       // of the source or bytecode
+        uint64_t    loads = 0;       // states that required it
+        uint64_t    compile_ns = 0;
+        uint64_t    run_ns = 0;
+    };
+
+    void   add(std::string const& name, uint8_t const* data, size_t size);   // the data must outlive the index
+    void   add_file(std::string const& name, std::string const& path);
+    size_t add_directory(std::string const& path);   // every .lua file below it, "a/b.lua" as "a.b" and "a/init.lua" as "a"
+
+    bool   contains(std::string const& name) const { return modules_.contains(name); }
+    size_t size() const { return modules_.size(); }
+
+    void install(lua_State* L);   // the index must outlive L
+
+    std::vector<Stats> stats() const;
+
+private:
+    struct Module {
+        std::string    path;               // empty if embedded
+        uint8_t const* data = nullptr;
+        size_t         size = 0;
+        std::shared_ptr<std::string const> bytecode;   // of the first compile, if it was source
+        uint64_t       loads = 0;
+        uint64_t       compile_ns = 0;
+        uint64_t       run_ns = 0;
+    };
+
+    int search(lua_State* L, std::string const& name);
+
+    static int lua_searcher(lua_State* L);
+    static int lua_loader(lua_State* L);
+    static int lua_modules(lua_State* L);
+
+    std::unordered_map<std::string, Module> modules_;
+    mutable std::mutex                      mutex_;    // guards the bytecode and the timings
+};
+
+#endif //MODULES_HH
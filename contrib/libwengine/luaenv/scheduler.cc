@@ -0,0 +1,255 @@
+#include "scheduler.hh"
+
+//
+// SIGNALS
+//
+
+void Scheduler::Signal::emit()
+{
+    for (Waiter const& waiter : waiters_)
+        scheduler_.ready_.push_back(waiter);
+    waiters_.clear();
+}
+
+//
+// LIFECYCLE
+//
+
+Scheduler::~Scheduler()
+{
+    for (Task::Handle h : roots_)
+        h.destroy();
+    if (L_) {
+        for (auto const& [co, thread] : threads_)
+            luaL_unref(L_, LUA_REGISTRYINDEX, thread.ref);
+    }
+}
+
+void Scheduler::install(lua_State* L)
+{
+    L_ = L;
+
+    static luaL_Reg const sched_lib[] {
+        { "spawn", lua_spawn },
+        { "sleep", lua_sleep },
+        { "wait",  lua_wait },
+        { "emit",  lua_emit },
+        { "now",   lua_now },
+        { nullptr, nullptr },
+    };
+
+    lua_newtable(L);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, sched_lib, 1);
+    lua_setglobal(L, "sched");
+}
+
+//
+// RUN QUEUE
+//
+
+void Scheduler::tick()
+{
+    ++now_;
+
+    while (!timers_.empty() && timers_.top().deadline <= now_) {
+        ready_.push_back(timers_.top().waiter);
+        timers_.pop();
+    }
+
+    ready_.insert(ready_.end(), next_.begin(), next_.end());
+    next_.clear();
+
+    try {
+        while (!ready_.empty()) {
+            Waiter waiter = ready_.front();
+            ready_.pop_front();
+            resume(waiter);
+        }
+    } catch (...) {
+        collect_roots();
+        throw;
+    }
+
+    collect_roots();
+}
+
+void Scheduler::resume(Waiter const& waiter)
+{
+    if (waiter.handle)
+        waiter.handle.resume();
+    else
+        resume_lua(waiter.thread, waiter.nargs);
+}
+
+void Scheduler::collect_roots()
+{
+    std::exception_ptr exception;
+
+    std::erase_if(roots_, [&](Task::Handle h) {
+        if (!h.done())
+            return false;
+        if (h.promise().exception && !exception)
+            exception = h.promise().exception;
+        h.destroy();
+        return true;
+    });
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+void Scheduler::spawn(Task task)
+{
+    Task::Handle h = task.release();
+    roots_.push_back(h);
+    ready_.push_back({ h, nullptr, 0 });
+}
+
+//
+// LUA THREADS
+//
+
+lua_State* Scheduler::new_lua_thread()
+{
+    lua_State* co = lua_newthread(L_);
+    int ref = luaL_ref(L_, LUA_REGISTRYINDEX);   // keeps the thread alive while it's scheduled
+    threads_.emplace(co, LuaThread { ref, {}, nullptr });
+    return co;
+}
+
+void Scheduler::spawn_lua(lua_State* from, int nargs)
+{
+    luaL_checktype(from, -nargs - 1, LUA_TFUNCTION);
+    lua_State* co = new_lua_thread();
+    lua_xmove(from, co, nargs + 1);
+    ready_.push_back({ {}, co, nargs });
+}
+
+void Scheduler::start_lua(lua_State* co, int nargs, std::coroutine_handle<> continuation, std::string* error)
+{
+    LuaThread& thread = threads_.at(co);
+    thread.continuation = continuation;
+    thread.error = error;
+    ready_.push_back({ {}, co, nargs });
+}
+
+void Scheduler::resume_lua(lua_State* co, int nargs)
+{
+    auto it = threads_.find(co);
+    if (it == threads_.end())
+        return;
+
+    parked_ = false;
+    int r;
+    try {
+        r = luaw_resume(L_, co, nargs);
+    } catch (LuawException& e) {
+        LuaThread thread = it->second;
+        threads_.erase(it);
+        luaL_unref(L_, LUA_REGISTRYINDEX, thread.ref);
+        if (!thread.continuation)
+            throw;
+        *thread.error = e.what();
+        ready_.push_back({ thread.continuation, nullptr, 0 });
+        return;
+    }
+
+    if (r == LUA_YIELD) {
+        lua_settop(co, 0);                       // values passed to a bare coroutine.yield() are discarded
+        if (!parked_)
+            next_.push_back({ {}, co, 0 });   // plain yield: run again on the next tick
+    } else {
+        LuaThread thread = it->second;
+        threads_.erase(it);
+        if (thread.continuation)
+            ready_.push_back({ thread.continuation, nullptr, 0 });
+        luaL_unref(L_, LUA_REGISTRYINDEX, thread.ref);
+    }
+}
+
+Scheduler::LuaThread& Scheduler::scheduled_thread(lua_State* co)
+{
+    auto it = threads_.find(co);
+    if (it == threads_.end())
+        luaL_error(co, "not running inside a scheduled coroutine (use sched.spawn)");
+    return it->second;
+}
+
+//
+// LUA AWAITING C++
+//
+
+Task Scheduler::bridge(Scheduler& scheduler, Task task, lua_State* co)
+{
+    std::string error;
+    try {
+        co_await std::move(task);
+    } catch (std::exception& e) {
+        error = e.what();
+    }
+
+    if (error.empty()) {
+        lua_pushboolean(co, true);
+        scheduler.ready_.push_back({ {}, co, 1 });
+    } else {
+        lua_pushnil(co);
+        luaw_push(co, error);
+        scheduler.ready_.push_back({ {}, co, 2 });
+    }
+}
+
+int Scheduler::await_from_lua(lua_State* co, Task task)
+{
+    scheduled_thread(co);
+    spawn(bridge(*this, std::move(task), co));
+    parked_ = true;
+    return lua_yield(co, 0);
+}
+
+//
+// LUA LIBRARY
+//
+
+static Scheduler* lua_scheduler(lua_State* L)
+{
+    return (Scheduler *) lua_touserdata(L, lua_upvalueindex(1));
+}
+
+int Scheduler::lua_spawn(lua_State* L)
+{
+    lua_scheduler(L)->spawn_lua(L, lua_gettop(L) - 1);
+    return 0;
+}
+
+int Scheduler::lua_sleep(lua_State* L)
+{
+    Scheduler* s = lua_scheduler(L);
+    lua_Integer ticks = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, ticks >= 0, 1, "negative number of ticks");
+    s->scheduled_thread(L);
+    s->add_timer((Tick) ticks, { {}, L, 0 });
+    s->parked_ = true;
+    return lua_yield(L, 0);
+}
+
+int Scheduler::lua_wait(lua_State* L)
+{
+    Scheduler* s = lua_scheduler(L);
+    std::string name = luaL_checkstring(L, 1);
+    s->scheduled_thread(L);
+    s->signal(name).waiters_.push_back({ {}, L, 0 });
+    s->parked_ = true;
+    return lua_yield(L, 0);
+}
+
+int Scheduler::lua_emit(lua_State* L)
+{
+    lua_scheduler(L)->signal(luaL_checkstring(L, 1)).emit();
+    return 0;
+}
+
+int Scheduler::lua_now(lua_State* L)
+{
+    return luaw_push(L, lua_scheduler(L)->now());
+}
@@ -0,0 +1,220 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <lua.hpp>
+#include "luaw/luaw.hh"
+
+class Scheduler;
+
+//
+// C++ coroutine that runs on the scheduler (starts suspended, owned by whoever holds the Task)
+//
+
+class Task {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle h) noexcept {
+            if (h.promise().continuation)
+                return h.promise().continuation;
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr      exception;
+
+        Task                get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter        final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Task& operator=(Task&& other) noexcept { if (this != &other) { destroy(); h_ = std::exchange(other.h_, {}); } return *this; }
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+    ~Task() { destroy(); }
+
+    // awaiting a task starts it and resumes the awaiter when it finishes
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle h;
+            bool await_ready() noexcept { return !h || h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+                h.promise().continuation = awaiter;
+                return h;
+            }
+            void await_resume() { if (h.promise().exception) std::rethrow_exception(h.promise().exception); }
+        };
+        return Awaiter { h_ };
+    }
+
+    Handle release() { return std::exchange(h_, {}); }
+
+private:
+    explicit Task(Handle h) : h_(h) {}
+    void destroy() { if (h_) h_.destroy(); h_ = {}; }
+
+    Handle h_;
+};
+
+//
+// Cooperative scheduler that runs C++ tasks and Lua threads on a shared run queue
+//
+
+class Scheduler {
+public:
+    using Tick = uint64_t;
+
+    // something that can be woken up: either a suspended C++ coroutine, or a Lua thread (with `nargs` values
+    // already pushed on its stack, that will be returned to the yielding function)
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        lua_State*              thread = nullptr;
+        int                     nargs = 0;
+    };
+
+    class Signal {
+    public:
+        explicit Signal(Scheduler& scheduler) : scheduler_(scheduler) {}
+
+        auto wait() {
+            struct Awaiter {
+                Signal& signal;
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { signal.waiters_.push_back({ h, nullptr, 0 }); }
+                void await_resume() noexcept {}
+            };
+            return Awaiter { *this };
+        }
+
+        void   emit();
+        size_t waiting() const { return waiters_.size(); }
+
+    private:
+        Scheduler&          scheduler_;
+        std::vector<Waiter> waiters_;
+
+        friend class Scheduler;
+    };
+
+    // C++ side awaiting a Lua function run as a Lua thread
+    class LuaCoroutine {
+    public:
+        LuaCoroutine(Scheduler& scheduler, lua_State* co, int nargs) : scheduler_(scheduler), co_(co), nargs_(nargs) {}
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { scheduler_.start_lua(co_, nargs_, h, &error_); }
+        void await_resume() { if (!error_.empty()) throw LuawException(error_.c_str()); }
+
+    private:
+        Scheduler&  scheduler_;
+        lua_State*  co_;
+        int         nargs_;
+        std::string error_;
+    };
+
+    Scheduler() = default;
+    Scheduler(Scheduler const&) = delete;
+    Scheduler& operator=(Scheduler const&) = delete;
+    ~Scheduler();
+
+    void install(lua_State* L);    // create the `sched` library on the main Lua state
+    void tick();                   // advance the clock and run everything that is ready (call with the Lua state locked)
+
+    void spawn(Task task);
+    void spawn_lua(lua_State* L, int nargs);   // function + nargs arguments on top of L
+
+    template <typename... Args> LuaCoroutine call(std::string const& global, Args&&... args);
+
+    int  await_from_lua(lua_State* co, Task task);   // to be returned from a lua_CFunction called inside a Lua thread
+
+    auto sleep(Tick ticks) {
+        struct Awaiter {
+            Scheduler& scheduler;
+            Tick       ticks;
+            bool await_ready() noexcept { return ticks == 0; }
+            void await_suspend(std::coroutine_handle<> h) { scheduler.add_timer(ticks, { h, nullptr, 0 }); }
+            void await_resume() noexcept {}
+        };
+        return Awaiter { *this, ticks };
+    }
+
+    Signal& signal(std::string const& name) { return signals_.try_emplace(name, *this).first->second; }
+
+    Tick       now() const { return now_; }
+    size_t     pending() const { return ready_.size() + next_.size() + timers_.size(); }
+    size_t     lua_threads() const { return threads_.size(); }
+    lua_State* lua_state() const { return L_; }
+
+private:
+    struct LuaThread {
+        int                     ref;
+        std::coroutine_handle<> continuation;
+        std::string*            error = nullptr;
+    };
+
+    struct Timer {
+        Tick     deadline;
+        uint64_t seq;
+        Waiter   waiter;
+        bool operator>(Timer const& other) const { return std::tie(deadline, seq) > std::tie(other.deadline, other.seq); }
+    };
+
+    lua_State* new_lua_thread();
+    void       start_lua(lua_State* co, int nargs, std::coroutine_handle<> continuation, std::string* error);
+    void       resume(Waiter const& waiter);
+    void       resume_lua(lua_State* co, int nargs);
+    void       add_timer(Tick ticks, Waiter waiter) { timers_.push({ now_ + ticks, timer_seq_++, waiter }); }
+    void       collect_roots();
+    LuaThread& scheduled_thread(lua_State* co);
+
+    static Task bridge(Scheduler& scheduler, Task task, lua_State* co);
+
+    static int lua_spawn(lua_State* L);
+    static int lua_sleep(lua_State* L);
+    static int lua_wait(lua_State* L);
+    static int lua_emit(lua_State* L);
+    static int lua_now(lua_State* L);
+
+    lua_State* L_ = nullptr;
+    Tick       now_ = 0;
+    uint64_t   timer_seq_ = 0;
+    bool       parked_ = false;   // set by the Lua library when the running thread registered itself somewhere
+
+    std::deque<Waiter>                                              ready_;
+    std::deque<Waiter>                                              next_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+    std::vector<Task::Handle>                                       roots_;
+    std::unordered_map<lua_State*, LuaThread>                       threads_;
+    std::unordered_map<std::string, Signal>                         signals_;
+};
+
+template <typename... Args>
+Scheduler::LuaCoroutine Scheduler::call(std::string const& global, Args&&... args)
+{
+    lua_State* co = new_lua_thread();
+    luaw_getglobal(co, global);
+    ([&] { luaw_push(co, args); } (), ...);
+    return { *this, co, (int) sizeof...(args) };
+}
+
+#endif //SCHEDULER_HH
@@ -0,0 +1,180 @@
+#include "shards.hh"
+
+#include "modules.hh"
+
+// No io or os: a shard's result must not depend on clocks or on the files around it, and without them (and
+// debug and ffi) a state also starts faster.
+static constexpr unsigned SHARD_LIBS = LUAW_LIB_BASE | LUAW_LIB_PACKAGE | LUAW_LIB_TABLE | LUAW_LIB_STRING | LUAW_LIB_MATH
+                                     | LUAW_LIB_BIT | LUAW_LIB_JIT;
+
+LuaShards::LuaShards(size_t n_shards, ModuleIndex* modules)
+{
+    static luaL_Reg const shard_lib[] {
+        { "send",    lua_send },
+        { "receive", lua_receive },
+        { nullptr, nullptr },
+    };
+
+    for (size_t i = 0; i < n_shards; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->id = (uint32_t) (i + 1);
+        shard->L = luaw_newstate(LUAW_DEFAULT_CHECK, SHARD_LIBS);
+        shard->owner = this;
+
+        lua_State* L = shard->L;
+        if (modules)
+            modules->install(L);
+        lua_newtable(L);
+        lua_pushlightuserdata(L, shard.get());
+        luaL_setfuncs(L, shard_lib, 1);
+        luaw_setfield(L, -1, "id", shard->id);
+        luaw_setfield(L, -1, "count", n_shards);
+        lua_setglobal(L, "shard");
+
+        shards_.push_back(std::move(shard));
+    }
+
+    for (auto& shard : shards_)
+        shard->thread = std::thread([this, s = shard.get()] { worker(*s); });
+}
+
+LuaShards::~LuaShards()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+
+    for (auto& shard : shards_) {
+        shard->thread.join();
+        lua_close(shard->L);
+    }
+}
+
+void LuaShards::run(size_t shard, std::string const& code, std::string const& name)
+{
+    luaw_do(shards_.at(shard - 1)->L, code, 0, name);
+}
+
+void LuaShards::run_all(std::string const& code, std::string const& name)
+{
+    for (auto& shard : shards_)
+        luaw_do(shard->L, code, 0, name);
+}
+
+//
+// STEP
+//
+
+void LuaShards::step()
+{
+    ++tick_;
+    deliver();
+
+    {
+        std::unique_lock lock(mutex_);
+        running_ = shards_.size();
+        ++generation_;
+        start_.notify_all();
+        done_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    for (auto& shard : shards_) {
+        if (shard->error) {
+            std::exception_ptr error = std::exchange(shard->error, nullptr);
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void LuaShards::worker(Shard& shard)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+
+        lua_State* L = shard.L;
+        try {
+            luaw_getglobal(L, "step");
+            if (lua_isfunction(L, -1))
+                luaw_call(L, tick_);
+            else
+                lua_pop(L, 1);
+        } catch (...) {
+            shard.error = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            if (--running_ == 0)
+                done_.notify_one();
+        }
+    }
+}
+
+// Called between steps (all workers idle): routes the outboxes to the inboxes. Outboxes are walked in shard
+// order, and each one is already in send order, so delivery is deterministic.
+void LuaShards::deliver()
+{
+    for (auto& shard : shards_) {
+        shard->inbox.clear();
+        shard->next_message = 0;
+    }
+
+    auto route = [this](std::vector<Message>& messages) {
+        for (Message& message : messages) {
+            shards_.at(message.to - 1)->inbox.push_back(std::move(message));
+            ++messages_delivered_;
+        }
+        messages.clear();
+    };
+
+    route(posted_);
+    for (auto& shard : shards_)
+        route(shard->outbox);
+}
+
+//
+// LUA LIBRARY
+//
+
+static LuaShards::Message* next_message(std::vector<LuaShards::Message>& inbox, size_t& next)
+{
+    if (next >= inbox.size())
+        return nullptr;
+    return &inbox[next++];
+}
+
+int LuaShards::lua_send(lua_State* L)
+{
+    Shard* shard = (Shard *) lua_touserdata(L, lua_upvalueindex(1));
+    lua_Integer to = luaL_checkinteger(L, 1);
+    std::string channel = luaL_checkstring(L, 2);
+    luaL_argcheck(L, to >= 1 && to <= (lua_Integer) shard->owner->size(), 1, "invalid shard");
+
+    return luaw_protect(L, [&] {
+        shard->outbox.push_back({ shard->id, (uint32_t) to, channel, luaw_serialize(L, 3) });
+        return 0;
+    });
+}
+
+int LuaShards::lua_receive(lua_State* L)
+{
+    Shard* shard = (Shard *) lua_touserdata(L, lua_upvalueindex(1));
+    Message* message = next_message(shard->inbox, shard->next_message);
+    if (!message)
+        return 0;
+
+    luaw_push(L, message->from);
+    luaw_push(L, message->channel);
+    luaw_deserialize(L, message->payload);
+    return 3;
+}
@@ -0,0 +1,105 @@
+#ifndef SHARDS_HH
+#define SHARDS_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <lua.hpp>
+#include "luaw/luaw.hh"
+
+class ModuleIndex;
+
+//
+// Scripted components split across several Lua states, each one running on its own worker thread.
+// On every step each shard calls its global `step(tick)` function; messages sent during a step are
+// delivered at the step boundary, ordered by (sending shard, send order), so the result does not
+// depend on thread timing.
+//
+// Shards open the base, package, table, string, math, bit and jit libraries; modules are loaded through
+// `require` from the index given, if any (see modules.hh). Inside a shard, the `shard` library is available:
+//   shard.id, shard.count
+//   shard.send(to, channel, value)         -- value is serialized (nil, boolean, number, string, table)
+//   shard.receive() -> from, channel, value   (nil when there are no more messages for this step)
+//
+
+class LuaShards {
+public:
+    struct Message {
+        uint32_t    from;    // 1-based shard id, 0 for messages posted from C++
+        uint32_t    to;
+        std::string channel;
+        std::string payload;
+    };
+
+    explicit LuaShards(size_t n_shards, ModuleIndex* modules=nullptr);   // modules are found through `require`
+    LuaShards(LuaShards const&) = delete;
+    LuaShards& operator=(LuaShards const&) = delete;
+    ~LuaShards();
+
+    // the following are only allowed between steps
+    void run(size_t shard, std::string const& code, std::string const& name="anonymous");
+    void run_all(std::string const& code, std::string const& name="anonymous");
+    template <typename T> void post(size_t to, std::string const& channel, T const& value);   // throws LuawException if it can't be serialized
+
+    void step();
+
+    size_t   size() const { return shards_.size(); }
+    uint64_t tick() const { return tick_; }
+    uint64_t messages_delivered() const { return messages_delivered_; }
+
+private:
+    struct Shard {
+        uint32_t             id;
+        lua_State*           L;
+        std::vector<Message> outbox;
+        std::vector<Message> inbox;
+        size_t               next_message = 0;
+        std::exception_ptr   error;
+        std::thread          thread;
+        LuaShards*           owner;
+    };
+
+    void worker(Shard& shard);
+    void deliver();
+
+    static int lua_send(lua_State* L);
+    static int lua_receive(lua_State* L);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<Message>                posted_;
+    uint64_t                            tick_ = 0;
+    uint64_t                            messages_delivered_ = 0;
+
+    std::mutex              mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    uint64_t                generation_ = 0;
+    size_t                  running_ = 0;
+    bool                    stop_ = false;
+};
+
+template <typename T> void LuaShards::post(size_t to, std::string const& channel, T const& value)
+{
+    if (to < 1 || to > shards_.size())
+        throw std::out_of_range("Invalid shard " + std::to_string(to));
+    lua_State* L = shards_.at(to - 1)->L;
+    luaw_push(L, value);
+    std::string payload;
+    try {
+        payload = luaw_serialize(L, -1);
+    } catch (LuawException&) {
+        lua_pop(L, 1);
+        throw;
+    }
+    lua_pop(L, 1);
+    posted_.push_back({ 0, (uint32_t) to, channel, std::move(payload) });
+}
+
+#endif //SHARDS_HH
@@ -1,5 +1,6 @@
 #include "luaw.hh"
 
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <vector>
@@ -43,17 +44,204 @@ mt.__index = function (t, n)
 end
 )";
 
-lua_State* luaw_newstate(bool strict)
+// Called with jit.util, a table for the declared globals, _G and a probe chunk (`w = r`), returns the function
+// that checks a chunk, or nothing if LuaJIT's bytecode isn't what it expects. The opcodes of GGET and GSET
+// change between LuaJIT versions, so they're found in the probe. Once it's found them, it also puts the
+// runtime half of the check in _G's metatable.
+static const char* check_globals_lua = R"(
+local util, declared, G, probe = ...
+local funcinfo, funcbc, funck = util.funcinfo, util.funcbc, util.funck
+local type, rawget, rawset, pairs, error, tostring = type, rawget, rawset, pairs, error, tostring
+local getmetatable, setmetatable = getmetatable, setmetatable
+
+local function operand_d(ins) return (ins - ins % 65536) / 65536 end
+
+local GGET, GSET
+local pc = 1
+while funcbc(probe, pc) do
+    local ins = funcbc(probe, pc)
+    local k = funck(probe, -operand_d(ins) - 1)
+    if k == "luaw_probe_r" then GGET = ins % 256 elseif k == "luaw_probe_w" then GSET = ins % 256 end
+    pc = pc + 1
+end
+if not GGET or not GSET or GGET == GSET then return end
+
+-- only called for globals that are nil; the declarations made when a top level runs (or from C++) are
+-- recorded as they happen, so what a module or the engine sets after a chunk is loaded can be read by it
+local mt = getmetatable(G) or {}
+mt.__index = function(_, n)
+    if not declared[n] then error("variable '" .. tostring(n) .. "' is not declared", 2) end
+end
+mt.__newindex = function(t, n, v)
+    declared[n] = true
+    rawset(t, n, v)
+end
+setmetatable(G, mt)
+
+local function scan(f, top, sets)
+    local pc = 1
+    while true do
+        local ins = funcbc(f, pc)
+        if not ins then break end
+        if ins % 256 == GSET then
+            sets[#sets + 1] = { f = f, pc = pc, name = funck(f, -operand_d(ins) - 1), top = top }
+        end
+        pc = pc + 1
+    end
+    local i = -1
+    while true do
+        local k = funck(f, i)
+        if k == nil then break end
+        if type(k) == "proto" then scan(k, false, sets) end
+        i = i - 1
+    end
+end
+
+return function(chunk)
+    local sets, assigned = {}, {}
+    scan(chunk, true, sets)
+    for i = 1, #sets do
+        if sets[i].top then assigned[sets[i].name] = true end
+    end
+    for i = 1, #sets do
+        local s = sets[i]
+        if not s.top and not assigned[s.name] and not declared[s.name] and rawget(G, s.name) == nil then
+            return (funcinfo(s.f, s.pc).loc or "?") .. ": assign to undeclared variable '" .. s.name .. "'"
+        end
+    end
+    for name in pairs(assigned) do declared[name] = true end
+end
+)";
+
+static char const* CHECK_KEY = "luaw.check";
+static char const* CHECK_GLOBALS_KEY = "luaw.check_globals";
+
+// puts the function from check_globals_lua in the registry, if LuaJIT's jit library is open
+static bool install_check_globals(lua_State* L)
+{
+#if LUAW == JIT
+    int top = lua_gettop(L);
+
+    // jit.util is preloaded by the jit library, even without the package library
+    lua_getfield(L, LUA_REGISTRYINDEX, "_PRELOAD");
+    if (lua_istable(L, -1))
+        lua_getfield(L, -1, "jit.util");
+    if (!lua_isfunction(L, -1) || lua_pcall(L, 0, 1, 0) != LUA_OK || !lua_istable(L, -1)) {
+        lua_settop(L, top);
+        return false;
+    }
+
+    int util = lua_gettop(L);
+    if (luaL_loadbuffer(L, check_globals_lua, strlen(check_globals_lua), "=check_globals") != LUA_OK) {
+        lua_settop(L, top);
+        return false;
+    }
+    lua_pushvalue(L, util);
+    lua_newtable(L);
+    lua_pushvalue(L, LUA_GLOBALSINDEX);
+    bool ok = luaL_loadstring(L, "luaw_probe_w = luaw_probe_r") == LUA_OK
+              && lua_pcall(L, 4, 1, 0) == LUA_OK && lua_isfunction(L, -1);
+    if (ok)
+        lua_setfield(L, LUA_REGISTRYINDEX, CHECK_GLOBALS_KEY);
+    lua_settop(L, top);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+lua_State* luaw_newstate(LuawCheck check, unsigned libs, bool strict)
 {
     lua_State* L = luaL_newstate();
-    luaL_openlibs(L);
+    luaw_openlibs(L, libs);
+
+    lua_pushinteger(L, (lua_Integer) check);
+    lua_setfield(L, LUA_REGISTRYINDEX, CHECK_KEY);
+    luaw_check_generation.fetch_add(1, std::memory_order_relaxed);
 
-    if (strict)
+    if (strict && check == LuawCheck::Full && !install_check_globals(L) && (libs & LUAW_LIB_DEBUG))
         luaw_do(L, strict_lua, 0, "strict.lua");
 
     return L;
 }
 
+// states not created by luaw_newstate get the default
+LuawCheck luaw_check_lookup(lua_State* L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, CHECK_KEY);
+    LuawCheck check = lua_isnumber(L, -1) ? (LuawCheck) lua_tointeger(L, -1) : LUAW_DEFAULT_CHECK;
+    lua_pop(L, 1);
+    return check;
+}
+
+std::string luaw_check_globals(lua_State* L, int index)
+{
+    if (luaw_check(L) != LuawCheck::Full || !lua_isfunction(L, index))
+        return "";
+    if (index < 0 && index > LUA_REGISTRYINDEX)
+        index = lua_gettop(L) + index + 1;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, CHECK_GLOBALS_KEY);
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 1);
+        return "";     // checked by strict.lua instead, if at all
+    }
+    lua_pushvalue(L, index);
+    if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+        std::string msg = "Error checking globals: "s + lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return msg;
+    }
+    std::string msg = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+    lua_pop(L, 1);
+    return msg;
+}
+
+void luaw_openlibs(lua_State* L, unsigned libs)
+{
+    struct Lib { unsigned flag; char const* name; lua_CFunction open; };
+    static Lib const all[] = {
+#if LUAW == JIT
+        { LUAW_LIB_BASE,    "",          luaopen_base },
+        { LUAW_LIB_PACKAGE, "package",   luaopen_package },
+        { LUAW_LIB_TABLE,   "table",     luaopen_table },
+        { LUAW_LIB_STRING,  "string",    luaopen_string },
+        { LUAW_LIB_MATH,    "math",      luaopen_math },
+        { LUAW_LIB_IO,      "io",        luaopen_io },
+        { LUAW_LIB_OS,      "os",        luaopen_os },
+        { LUAW_LIB_DEBUG,   "debug",     luaopen_debug },
+        { LUAW_LIB_BIT,     "bit",       luaopen_bit },
+        { LUAW_LIB_JIT,     "jit",       luaopen_jit },
+        { LUAW_LIB_FFI,     "ffi",       luaopen_ffi },
+#else
+        { LUAW_LIB_BASE,    "_G",        luaopen_base },
+        { LUAW_LIB_BASE,    "coroutine", luaopen_coroutine },
+        { LUAW_LIB_BASE,    "utf8",      luaopen_utf8 },
+        { LUAW_LIB_PACKAGE, "package",   luaopen_package },
+        { LUAW_LIB_TABLE,   "table",     luaopen_table },
+        { LUAW_LIB_STRING,  "string",    luaopen_string },
+        { LUAW_LIB_MATH,    "math",      luaopen_math },
+        { LUAW_LIB_IO,      "io",        luaopen_io },
+        { LUAW_LIB_OS,      "os",        luaopen_os },
+        { LUAW_LIB_DEBUG,   "debug",     luaopen_debug },
+#endif
+    };
+
+    for (Lib const& lib : all) {
+        if (!(libs & lib.flag))
+            continue;
+#if LUAW == JIT
+        // as luaL_openlibs does it
+        lua_pushcfunction(L, lib.open);
+        lua_pushstring(L, lib.name);
+        lua_call(L, 1, 0);
+#else
+        luaL_requiref(L, lib.name, lib.open, 1);
+        lua_pop(L, 1);
+#endif
+    }
+}
+
 void luaw_do(lua_State* L, uint8_t* data, size_t sz, int nresults, std::string const& name)
 {
     int r = luaL_loadbuffer(L, (char const *) data, sz, name.c_str());
@@ -65,6 +253,12 @@ void luaw_do(lua_State* L, uint8_t* data, size_t sz, int nresults, std::string c
         luaL_error(L, "Memory error");
     }
 
+    std::string undeclared = luaw_check_globals(L, -1);
+    if (!undeclared.empty()) {
+        lua_pop(L, 1);
+        luaL_error(L, "%s", undeclared.c_str());
+    }
+
     r = lua_pcall(L, 0, nresults, 0);
     if (r == LUA_ERRRUN) {
         std::string msg = "Runtime error: "s + lua_tostring(L, -1);
@@ -249,6 +443,19 @@ void luaw_getfield(lua_State* L, int index, std::string const& field, bool quali
     }
 }
 
+void luaw_getglobal(lua_State* L, std::string const& global)
+{
+#if LUAW == JIT
+    lua_pushstring(L, global.c_str());
+    lua_rawget(L, LUA_GLOBALSINDEX);
+#else
+    lua_pushglobaltable(L);
+    lua_pushstring(L, global.c_str());
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+#endif
+}
+
 bool luaw_hasfield(lua_State* L, int index, std::string const& field, bool qualified_search)
 {
     if (qualified_search) {
@@ -312,6 +519,132 @@ void luaw_setfield(lua_State* L, int index, std::string const& field, bool quali
     }
 }
 
+int luaw_resume(lua_State* L, lua_State* co, int nargs)
+{
+#if LUAW == JIT
+    int r = lua_resume(co, nargs);
+#else
+    int nres;
+    int r = lua_resume(co, L, nargs, &nres);
+#endif
+    if (r != LUA_OK && r != LUA_YIELD) {
+        luaL_traceback(L, co, lua_tostring(co, -1), 0);
+        std::string msg = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        lua_settop(co, 0);
+        throw LuawException(msg.c_str());
+    }
+    return r;
+}
+
+enum SerialTag : uint8_t { S_NIL, S_FALSE, S_TRUE, S_NUMBER, S_STRING, S_TABLE, S_END };
+
+static void luaw_serialize_value(lua_State* L, int index, std::string& out, size_t max_depth)
+{
+    switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            out += (char) S_NIL;
+            break;
+        case LUA_TBOOLEAN:
+            out += (char) (luaw_to<bool>(L, index) ? S_TRUE : S_FALSE);
+            break;
+        case LUA_TNUMBER: {
+            double n = luaw_to<double>(L, index);
+            out += (char) S_NUMBER;
+            out.append((char const *) &n, sizeof n);
+            break;
+        }
+        case LUA_TSTRING: {
+            size_t len;
+            char const* str = lua_tolstring(L, index, &len);
+            uint32_t len32 = (uint32_t) len;
+            out += (char) S_STRING;
+            out.append((char const *) &len32, sizeof len32);
+            out.append(str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            if (max_depth == 0)
+                throw LuawException("Table too deep to serialize (cyclic?)");
+            out += (char) S_TABLE;
+            luaw_pairs(L, index, [&](lua_State* L) {
+                luaw_serialize_value(L, -2, out, max_depth - 1);
+                luaw_serialize_value(L, -1, out, max_depth - 1);
+            });
+            out += (char) S_END;
+            break;
+        default:
+            throw LuawException(("Values of type '"s + lua_typename(L, lua_type(L, index)) + "' cannot be serialized").c_str());
+    }
+}
+
+std::string luaw_serialize(lua_State* L, int index, size_t max_depth)
+{
+    std::string out;
+    int top = lua_gettop(L);
+    try {
+        luaw_serialize_value(L, index, out, max_depth);
+    } catch (LuawException&) {
+        lua_settop(L, top);   // drop what the iteration left on the stack
+        throw;
+    }
+    return out;
+}
+
+static size_t luaw_deserialize_value(lua_State* L, std::string_view data, size_t pos)
+{
+    auto need = [&](size_t n) {
+        if (pos + n > data.size())
+            luaL_error(L, "Truncated serialized data");
+    };
+
+    need(1);
+    switch ((SerialTag) data[pos++]) {
+        case S_NIL:
+            lua_pushnil(L);
+            return pos;
+        case S_FALSE:
+        case S_TRUE:
+            luaw_push(L, data[pos - 1] == S_TRUE);
+            return pos;
+        case S_NUMBER: {
+            double n;
+            need(sizeof n);
+            memcpy(&n, data.data() + pos, sizeof n);
+            luaw_push(L, n);
+            return pos + sizeof n;
+        }
+        case S_STRING: {
+            uint32_t len;
+            need(sizeof len);
+            memcpy(&len, data.data() + pos, sizeof len);
+            pos += sizeof len;
+            need(len);
+            lua_pushlstring(L, data.data() + pos, len);
+            return pos + len;
+        }
+        case S_TABLE:
+            lua_newtable(L);
+            for (;;) {
+                need(1);
+                if (data[pos] == S_END)
+                    return pos + 1;
+                pos = luaw_deserialize_value(L, data, pos);
+                pos = luaw_deserialize_value(L, data, pos);
+                lua_rawset(L, -3);
+            }
+        case S_END:
+            break;
+    }
+    luaL_error(L, "Invalid serialized data");
+    return pos;
+}
+
+void luaw_deserialize(lua_State* L, std::string_view data)
+{
+    luaw_deserialize_value(L, data, 0);
+}
+
 std::string luaw_to_string(lua_State* L, int index)
 {
     lua_getglobal(L, "tostring");
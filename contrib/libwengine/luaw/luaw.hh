@@ -5,11 +5,56 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 
 #include <lua.hpp>
 
-lua_State* luaw_newstate(bool strict=true);
+// standard libraries to open in a new state (bit, jit and ffi are LuaJIT's; coroutine and utf8 come with
+// base elsewhere). Opening jit is also what turns LuaJIT's compiler on: without it, code is only interpreted.
+enum : unsigned {
+    LUAW_LIB_BASE    = 1 << 0,
+    LUAW_LIB_PACKAGE = 1 << 1,
+    LUAW_LIB_TABLE   = 1 << 2,
+    LUAW_LIB_STRING  = 1 << 3,
+    LUAW_LIB_MATH    = 1 << 4,
+    LUAW_LIB_IO      = 1 << 5,
+    LUAW_LIB_OS      = 1 << 6,
+    LUAW_LIB_DEBUG   = 1 << 7,
+    LUAW_LIB_BIT     = 1 << 8,
+    LUAW_LIB_JIT     = 1 << 9,
+    LUAW_LIB_FFI     = 1 << 10,
+    LUAW_LIBS_ALL    = (1 << 11) - 1,
+};
+
+// how much is checked in a state: the values converted by luaw_to, and the globals its scripts use (if the
+// state is strict). A value that fails the check throws LuawException, which luaw_protect turns into a Lua
+// error in C functions.
+enum class LuawCheck : uint8_t {
+    None,   // values are converted as they are, and globals aren't checked
+    Tag,    // luaw_to compares the Lua type of the value with what the C++ type can be converted from
+    Full,   // luaw_to checks the whole value (table contents, userdata metatables) and describes it in the
+            // error; the globals of a strict state are checked as by strict.lua (see luaw_check_globals)
+};
+
+#ifdef DEV
+constexpr LuawCheck LUAW_DEFAULT_CHECK = LuawCheck::Full;
+#else
+constexpr LuawCheck LUAW_DEFAULT_CHECK = LuawCheck::Tag;
+#endif
+
+lua_State* luaw_newstate(LuawCheck check=LUAW_DEFAULT_CHECK, unsigned libs=LUAW_LIBS_ALL, bool strict=true);
+void       luaw_openlibs(lua_State* L, unsigned libs);
+inline LuawCheck luaw_check(lua_State* L);
+
+// At LuawCheck::Full, the globals of a strict state follow strict.lua's rules: only the top level of a chunk
+// (or C++) may assign a new global, and reading one that was never assigned is an error. The assignments are
+// checked once, when a chunk is loaded: this checks the function at `index` (a chunk just loaded) and returns
+// what's wrong (with the file and line), or "". The reads are checked as they happen, by an __index on _G that
+// only runs for globals that are nil. This needs LuaJIT's jit library to read the bytecode; without it,
+// strict.lua itself is used (which needs the debug library). luaw_do calls it for everything it loads. C++
+// reads globals with luaw_getglobal, which isn't checked.
+std::string luaw_check_globals(lua_State* L, int index);
 
 // file loading
 
@@ -51,6 +96,7 @@ struct WrappedUserdata { void* object; };
 
 // globals
 
+void                       luaw_getglobal(lua_State* L, std::string const& global);   // pushes it, without metamethods
 template <typename T> T    luaw_getglobal(lua_State* L, std::string const& global);
 template <typename T> void luaw_setglobal(lua_State* L, std::string const& global, T const& t);
 
@@ -79,6 +125,17 @@ int luaw_call_push(lua_State* L, int nresults, auto&&... args);
 int luaw_call_push_global(lua_State* L, std::string const& global, int nresults, auto&&... args);
 int luaw_call_push_field(lua_State* L, int index, std::string const& field, int nresults, auto&&... args);
 
+template <typename F> int luaw_protect(lua_State* L, F f);
+
+// coroutines
+
+int luaw_resume(lua_State* L, lua_State* co, int nargs);   // returns LUA_OK or LUA_YIELD, throws on error
+
+// serialization (nil, booleans, numbers, strings and tables of those)
+
+std::string luaw_serialize(lua_State* L, int index, size_t max_depth=64);    // throws LuawException
+void        luaw_deserialize(lua_State* L, std::string_view data);   // pushes the value
+
 // metatables
 
 using LuaMetatable = std::map<std::string, lua_CFunction>;
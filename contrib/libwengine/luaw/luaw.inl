@@ -1,6 +1,10 @@
 #ifndef LUA_INL_
 #define LUA_INL_
 
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
 #include <optional>
 #include <map>
 #include <string>
@@ -108,6 +112,26 @@ const char* mt_identifier() {
         return typeid(std::remove_pointer_t<T>).name();
 }
 
+//
+// EXCEPTIONS
+//
+
+struct LuawException : public std::runtime_error {
+    explicit LuawException(const char* msg) : std::runtime_error(msg) {}
+};
+
+// run a lua_CFunction body, turning C++ exceptions into Lua errors
+template <typename F> int luaw_protect(lua_State* L, F f)
+{
+    char error[256];
+    try {
+        return f();
+    } catch (std::exception& e) {
+        snprintf(error, sizeof error, "%s", e.what());
+    }
+    return luaL_error(L, "%s", error);
+}
+
 //
 // CODE LOADING
 //
@@ -124,39 +148,140 @@ template <typename T> T luaw_do(lua_State* L, std::string const& buffer, std::st
 
 template <typename T> T luaw_to(lua_State* L, int index, T const& default_)
 {
-    if (lua_isnil(L, -1))
+    if (lua_isnil(L, index))
         return default_;
     else
         return luaw_to<T>(L, index);
 }
 
-template <typename T> T luaw_to(lua_State* L, int index)
+// The tier of a state is kept in its registry. As luaw_to asks for it on every conversion, it's cached for
+// the last state used on each thread, and the cache is dropped whenever a state is created (as it may reuse
+// the address of a closed one).
+
+struct LuawCheckCache {
+    lua_State* L = nullptr;
+    uint64_t   generation = 0;
+    LuawCheck  check = LUAW_DEFAULT_CHECK;
+};
+
+inline thread_local LuawCheckCache luaw_check_cache;
+inline std::atomic<uint64_t>       luaw_check_generation = 1;
+
+LuawCheck luaw_check_lookup(lua_State* L);
+
+inline LuawCheck luaw_check(lua_State* L)
 {
-    /*
-    if (!luaw_is<T>(L, index)) {
-        std::string cpp_type = typeid(T).name();
+    LuawCheckCache& cache = luaw_check_cache;
+    uint64_t generation = luaw_check_generation.load(std::memory_order_relaxed);
+    if (cache.L != L || cache.generation != generation)
+        cache = { L, generation, luaw_check_lookup(L) };
+    return cache.check;
+}
 
-        int status = -4;
-        std::unique_ptr<char, void(*)(void*)> res {
-                abi::__cxa_demangle(cpp_type.c_str(), NULL, NULL, &status),
-                std::free
-        };
+// the Lua types T can be converted from, as bits 1 << (type + 1), for LuawCheck::Tag
+template <typename T> constexpr unsigned luaw_tags()
+{
+    constexpr auto bit = [](int type) { return 1u << (type + 1); };
+    if constexpr (std::is_same_v<T, bool>)
+        return ~0u;     // every value is true or false, as in Lua
+    else if constexpr (IntegerType<T> || FloatingType<T> || std::is_same_v<T, std::string> || std::is_same_v<T, const char*>)
+        return bit(LUA_TNUMBER) | bit(LUA_TSTRING);
+    else if constexpr (PointerType<T>)
+        return bit(LUA_TUSERDATA) | bit(LUA_TLIGHTUSERDATA) | bit(LUA_TTABLE);
+    else if constexpr (Optional<T>)
+        return bit(LUA_TNONE) | bit(LUA_TNIL) | luaw_tags<typename T::value_type>();
+    else if constexpr (Iterable<T> || MapType<T> || Tuple<T>)
+        return bit(LUA_TTABLE);
+    else
+        return ~0u;
+}
+
+// LuawCheck::Full: luaw_is, and for pointers, the metatable registered for the type (if any) must be the value's
+template <typename T> bool luaw_is_full(lua_State* L, int index)
+{
+    if constexpr (ConvertibleToLua<T> && !ComparableToLua<T>) {
+        return true;    // nothing to check it with
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return true;    // as for Tag
+    } else {
+        if (!luaw_is<T>(L, index))
+            return false;
+        if constexpr (PointerType<T>) {
+            if (index < 0 && index > LUA_REGISTRYINDEX)
+                index = lua_gettop(L) + index + 1;
+            luaL_getmetatable(L, mt_identifier<T>());
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+                return true;
+            }
+            int pushed = 1 + lua_getmetatable(L, index);
+            bool same = pushed == 2 && lua_rawequal(L, -1, -2);
+            lua_pop(L, pushed);
+            return same;
+        }
+        return true;
+    }
+}
+
+// thrown rather than raised as a Lua error, as luaw_to is also used outside of C functions (luaw_call, luaw_getfield,
+// LUAW_FIELD...): luaw_protect turns it into a Lua error in the C functions
+template <typename T> [[noreturn]] void luaw_type_error(lua_State* L, int index, LuawCheck check)
+{
+    char msg[512];
+    if (check == LuawCheck::Tag) {
+        std::string expected;
+        for (int type = LUA_TNONE; type <= LUA_TTHREAD; ++type)
+            if (luaw_tags<T>() & (1u << (type + 1)))
+                expected += std::string(expected.empty() ? "" : " or ") + (type == LUA_TNONE ? "none" : lua_typename(L, type));
+        snprintf(msg, sizeof msg, "Type unexpected (expected %s, got %s)", expected.c_str(), lua_typename(L, lua_type(L, index)));
+        throw LuawException(msg);
+    }
+
+    std::string cpp_type = typeid(T).name();
 
-        if (status == 0)
-            cpp_type = res.get();
+    int status = -4;
+    std::unique_ptr<char, void(*)(void*)> res {
+            abi::__cxa_demangle(cpp_type.c_str(), NULL, NULL, &status),
+            std::free
+    };
 
-        luaL_error(L, "Type unexpected (expected C++ type `%s`, actual lua type is `%s` (%s))",
-                   cpp_type.c_str(), lua_typename(L, lua_type(L, index)), luaw_dump(L, index, false).c_str());
+    if (status == 0)
+        cpp_type = res.get();
+
+    snprintf(msg, sizeof msg, "Type unexpected (expected C++ type `%s`, actual lua type is `%s` (%s))",
+             cpp_type.c_str(), lua_typename(L, lua_type(L, index)), luaw_dump(L, index, false).c_str());
+    throw LuawException(msg);
+}
+
+template <typename T> T luaw_to(lua_State* L, int index)
+{
+    if constexpr (!std::is_same_v<T, std::nullptr_t>) {   // (a discarded value)
+        switch (LuawCheck check = luaw_check(L)) {
+            case LuawCheck::None:
+                break;
+            case LuawCheck::Tag:
+                if (!(luaw_tags<T>() & (1u << (lua_type(L, index) + 1))))
+                    luaw_type_error<T>(L, index, check);
+                break;
+            case LuawCheck::Full:
+                if (!luaw_is_full<T>(L, index))
+                    luaw_type_error<T>(L, index, check);
+                break;
+        }
     }
-    */
     return luaw_to_<T>(L, index);
 }
 
 template <typename T> T luaw_pop(lua_State* L)
 {
-    T t = (T) luaw_to<T>(L, -1);
-    lua_pop(L, 1);
-    return t;
+    try {
+        T t = (T) luaw_to<T>(L, -1);
+        lua_pop(L, 1);
+        return t;
+    } catch (LuawException&) {
+        lua_pop(L, 1);   // popped either way, so a failed luaw_call leaves the stack as it found it
+        throw;
+    }
 }
 
 //
@@ -241,8 +366,7 @@ template <PointerType T> T luaw_to_(lua_State* L, int index)
         lua_pop(L, 1);
         return ptr;
     } else {
-        luaL_error(L, "Unexpected type - not a userdata");
-        return nullptr;
+        throw LuawException("Unexpected type - not a userdata");
     }
 }
 
@@ -433,7 +557,7 @@ std::variant<T, Types...> lua_to(lua_State* L, int index) {
 
 template <typename T> T luaw_getglobal(lua_State* L, std::string const& global)
 {
-    lua_getglobal(L, global.c_str());
+    luaw_getglobal(L, global);
     return luaw_pop<T>(L);
 }
 
@@ -506,9 +630,7 @@ template <Optional T> T luaw_getfield(lua_State* L, int index, std::string const
 template <typename T> T luaw_getfield(lua_State* L, int index, std::string const& field, bool qualified_search)
 {
     luaw_getfield(L, index, field, qualified_search);
-    T t = luaw_to<T>(L, -1);
-    lua_pop(L, 1);
-    return t;
+    return luaw_pop<T>(L);
 }
 
 template <typename T> void luaw_setfield(lua_State* L, int index, std::string const& field, T const& t, bool qualified_search)
@@ -517,25 +639,16 @@ template <typename T> void luaw_setfield(lua_State* L, int index, std::string co
     luaw_setfield(L, index - 1, field, qualified_search);
 }
 
-//
-// EXCEPTIONS
-//
-
-struct LuawException : public std::runtime_error {
-    explicit LuawException(const char* msg) : std::runtime_error(msg) {}
-};
-
 //
 // CALLS
 //
 
+// luaL_traceback rather than debug.traceback, as the debug library may not be open
 static int luaw_error_handler(lua_State* L)
 {
-    lua_getglobal(L, "debug");
-    lua_getfield(L, -1, "traceback");
-    lua_pushvalue(L, 1);  // The error message
-    lua_pushnumber(L, 2); // Skip this function in the traceback
-    lua_call(L, 2, 1);
+    if (!lua_isstring(L, 1))
+        return 1;    // leave other error objects as they are
+    luaL_traceback(L, L, lua_tostring(L, 1), 1);   // skip this function in the traceback
     return 1;
 }
 
@@ -560,7 +673,7 @@ template <typename T> T luaw_call(lua_State* L, auto&&... args)
 
 template <typename T> T luaw_call_global(lua_State* L, std::string const& global, auto&&... args)
 {
-    lua_getglobal(L, global.c_str());
+    luaw_getglobal(L, global);
     return luaw_call<T>(L, args...);
 }
 
@@ -570,7 +683,7 @@ template <typename T> T luaw_call_field(lua_State* L, int index, std::string con
     return luaw_call<T>(L, args...);
 }
 
-int luaw_call_push(lua_State* L, int nresults, auto&... args)
+int luaw_call_push(lua_State* L, int nresults, auto&&... args)
 {
     ([&] { luaw_push(L, args); } (), ...);
     luaw_pcall(L, sizeof...(args), nresults);
@@ -579,7 +692,7 @@ int luaw_call_push(lua_State* L, int nresults, auto&... args)
 
 int luaw_call_push_global(lua_State* L, std::string const& global, int nresults, auto&&... args)
 {
-    lua_getglobal(L, global.c_str());
+    luaw_getglobal(L, global);
     ([&] { luaw_push(L, args); } (), ...);
     luaw_pcall(L, sizeof...(args), nresults);
     return nresults;
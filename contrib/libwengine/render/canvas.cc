@@ -0,0 +1,196 @@
+#include "canvas.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+Rect CanvasItem::bounds() const
+{
+    float pad = kind == ItemKind::Segment ? thickness / 2 : kind == ItemKind::Pin ? Canvas::PIN_RADIUS : 0;
+    float x = std::min(x0, x1), y = std::min(y0, y1);
+    return { x - pad, y - pad, std::max(x0, x1) - x + 2 * pad, std::max(y0, y1) - y + 2 * pad };
+}
+
+float CanvasItem::distance(float x, float y) const
+{
+    switch (kind) {
+        case ItemKind::Sprite:
+            return std::hypot(std::max({ x0 - x, 0.0f, x - x1 }), std::max({ y0 - y, 0.0f, y - y1 }));
+        case ItemKind::Segment: {
+            float dx = x1 - x0, dy = y1 - y0;
+            float len2 = dx * dx + dy * dy;
+            float t = len2 == 0 ? 0 : std::clamp(((x - x0) * dx + (y - y0) * dy) / len2, 0.0f, 1.0f);
+            return std::max(std::hypot(x - (x0 + t * dx), y - (y0 + t * dy)) - thickness / 2, 0.0f);
+        }
+        case ItemKind::Pin:
+            return std::hypot(x - x0, y - y0);
+        case ItemKind::None:
+            break;
+    }
+    return std::numeric_limits<float>::infinity();
+}
+
+//
+// ITEMS
+//
+
+ItemId Canvas::add_sprite(Rect const& box, AtlasId atlas, uint16_t tile, WireId wire)
+{
+    return add({ .kind = ItemKind::Sprite, .atlas = atlas, .tile = tile, .wire = wire,
+                 .x0 = box.x, .y0 = box.y, .x1 = box.right(), .y1 = box.bottom() });
+}
+
+ItemId Canvas::add_segment(float x0, float y0, float x1, float y1, float thickness, WireId wire)
+{
+    return add({ .kind = ItemKind::Segment, .wire = wire, .x0 = x0, .y0 = y0, .x1 = x1, .y1 = y1, .thickness = thickness });
+}
+
+ItemId Canvas::add_pin(float x, float y, WireId wire)
+{
+    return add({ .kind = ItemKind::Pin, .wire = wire, .x0 = x, .y0 = y, .x1 = x, .y1 = y });
+}
+
+ItemId Canvas::add(CanvasItem const& item)
+{
+    check_new_item(item);
+    ItemId id = (ItemId) items_.size();
+    items_.push_back(item);
+    grid_.insert(id, item.bounds());
+    index_wire(id, item.wire);
+    return id;
+}
+
+ItemId Canvas::add_items(std::span<CanvasItem const> items)
+{
+    for (CanvasItem const& item : items)
+        check_new_item(item);
+
+    ItemId first = (ItemId) items_.size();
+    std::vector<SpatialGrid<ItemId>::Entry> entries;
+    entries.reserve(items.size());
+    items_.reserve(items_.size() + items.size());
+    for (CanvasItem const& item : items) {
+        ItemId id = (ItemId) items_.size();
+        items_.push_back(item);
+        entries.push_back({ id, item.bounds() });
+        index_wire(id, item.wire);
+    }
+    grid_.insert(entries);
+    return first;
+}
+
+void Canvas::index_wire(ItemId id, WireId w)
+{
+    if (w == NO_WIRE)
+        return;
+    if (w >= wire_items_.size())
+        wire_items_.resize(w + 1);
+    wire_items_[w].push_back(id);
+}
+
+void Canvas::check_new_item(CanvasItem const& item)
+{
+    switch (item.kind) {
+        case ItemKind::Sprite:
+            if (item.x1 < item.x0 || item.y1 < item.y0)
+                throw std::invalid_argument("Sprite with negative size");
+            break;
+        case ItemKind::Segment:
+            if (item.thickness <= 0)
+                throw std::invalid_argument("Segment thickness must be positive");
+            break;
+        case ItemKind::Pin:
+            break;
+        case ItemKind::None:
+            throw std::invalid_argument("Canvas item without a kind");
+    }
+}
+
+void Canvas::move(ItemId id, float dx, float dy)
+{
+    check_item(id);
+    CanvasItem& item = items_[id];
+    grid_.remove(id, item.bounds());
+    item.x0 += dx; item.x1 += dx;
+    item.y0 += dy; item.y1 += dy;
+    grid_.insert(id, item.bounds());
+}
+
+void Canvas::remove(ItemId id)
+{
+    check_item(id);
+    CanvasItem& item = items_[id];
+    grid_.remove(id, item.bounds());
+    if (item.wire != NO_WIRE)
+        std::erase(wire_items_[item.wire], id);
+    item.kind = ItemKind::None;
+    ++removed_;
+}
+
+CanvasItem const& Canvas::item(ItemId id) const
+{
+    check_item(id);
+    return items_[id];
+}
+
+std::span<ItemId const> Canvas::items_of_wire(WireId w) const
+{
+    if (w >= wire_items_.size())
+        return {};
+    return wire_items_[w];
+}
+
+//
+// QUERIES
+//
+
+ItemId Canvas::hit(float x, float y, float tolerance) const
+{
+    ItemId top = NO_ITEM;
+    grid_.query({ x - tolerance, y - tolerance, 2 * tolerance, 2 * tolerance }, [&](ItemId id, Rect const&) {
+        CanvasItem const& item = items_[id];
+        float reach = tolerance + (item.kind == ItemKind::Pin ? PIN_RADIUS : 0);
+        if ((top == NO_ITEM || id > top) && item.distance(x, y) <= reach)
+            top = id;
+    });
+    return top;
+}
+
+void Canvas::select(Rect const& area, bool contained, std::vector<ItemId>& out) const
+{
+    grid_.query(area, [&](ItemId id, Rect const& b) {
+        if (!contained || (b.x >= area.x && b.y >= area.y && b.right() <= area.right() && b.bottom() <= area.bottom()))
+            out.push_back(id);
+    });
+}
+
+void Canvas::nearest(float x, float y, size_t k, ItemKind kind, std::vector<std::pair<ItemId, float>>& out) const
+{
+    auto distance = [&](ItemId id, Rect const&) {
+        CanvasItem const& item = items_[id];
+        return kind == ItemKind::None || item.kind == kind ? item.distance(x, y) : std::numeric_limits<float>::infinity();
+    };
+    grid_.nearest(x, y, k, distance, [&](ItemId id, float d) { out.emplace_back(id, d); });
+}
+
+//
+// ATLASES
+//
+
+void Canvas::set_atlas(AtlasId id, std::string const& path, int tile_w, int tile_h)
+{
+    if (path.empty())
+        throw std::invalid_argument("Atlas path is empty");
+    if (tile_w <= 0 || tile_h <= 0)
+        throw std::invalid_argument("Atlas tile size must be positive");
+    if (id >= atlases_.size())
+        atlases_.resize(id + 1);
+    atlases_[id] = { path, tile_w, tile_h };
+    ++atlas_revision_;
+}
+
+void Canvas::check_item(ItemId id) const
+{
+    if (id >= items_.size() || items_[id].kind == ItemKind::None)
+        throw std::out_of_range("Canvas item does not exist");
+}
@@ -0,0 +1,93 @@
+#ifndef CANVAS_HH
+#define CANVAS_HH
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geom/spatial_grid.hh"
+#include "sim/netlist.hh"
+
+using ItemId = uint32_t;
+using AtlasId = uint16_t;
+
+constexpr ItemId NO_ITEM = std::numeric_limits<ItemId>::max();
+
+enum class ItemKind : uint8_t { None, Sprite, Segment, Pin };   // None: removed
+
+// A sprite is tile `tile` of a texture atlas drawn over the box (x0, y0)-(x1, y1); a segment is a line
+// between the two points; a pin is the point (x0, y0), where segments connect. Any may show the value of a
+// simulation wire.
+struct CanvasItem {
+    ItemKind kind = ItemKind::None;
+    AtlasId  atlas = 0;
+    uint16_t tile = 0;
+    WireId   wire = NO_WIRE;
+    float    x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    float    thickness = 1;
+
+    Rect  bounds() const;
+    float distance(float x, float y) const;   // from the point to the item's shape (0 inside a sprite)
+};
+
+struct AtlasInfo {
+    std::string path;          // empty: not registered
+    int         tile_w = 0;
+    int         tile_h = 0;
+};
+
+//
+// What is drawn of a circuit, in world units, indexed by a spatial grid so the renderer only visits the
+// items in view. The canvas knows nothing about the GPU: atlases are only registered here, and loaded by
+// the renderer. Removed items keep their id (as a None item).
+//
+
+class Canvas {
+public:
+    static constexpr float CELL_SIZE = 256;   // world units per grid cell (also the renderer's cached chunks)
+    static constexpr float PIN_RADIUS = 2;
+
+    Canvas() : grid_(CELL_SIZE) {}
+
+    ItemId add_sprite(Rect const& box, AtlasId atlas, uint16_t tile, WireId wire = NO_WIRE);
+    ItemId add_segment(float x0, float y0, float x1, float y1, float thickness = 1, WireId wire = NO_WIRE);
+    ItemId add_pin(float x, float y, WireId wire = NO_WIRE);
+    ItemId add_items(std::span<CanvasItem const> items);   // bulk load; returns the id of the first
+    void   move(ItemId id, float dx, float dy);
+    void   remove(ItemId id);
+
+    CanvasItem const&       item(ItemId id) const;
+    size_t                  item_count() const { return items_.size() - removed_; }
+    std::span<ItemId const> items_of_wire(WireId w) const;
+
+    // queries
+
+    ItemId hit(float x, float y, float tolerance = 0) const;   // topmost (last added) item under the point, or NO_ITEM
+    void   select(Rect const& area, bool contained, std::vector<ItemId>& out) const;   // intersecting, or contained in, `area`
+    void   nearest(float x, float y, size_t k, ItemKind kind, std::vector<std::pair<ItemId, float>>& out) const;   // kind None: any
+
+    void set_atlas(AtlasId id, std::string const& path, int tile_w, int tile_h);
+    std::vector<AtlasInfo> const& atlases() const { return atlases_; }
+    uint32_t                      atlas_revision() const { return atlas_revision_; }
+
+    SpatialGrid<ItemId>&       grid()       { return grid_; }
+    SpatialGrid<ItemId> const& grid() const { return grid_; }
+
+private:
+    ItemId add(CanvasItem const& item);
+    void   index_wire(ItemId id, WireId w);
+    void   check_item(ItemId id) const;
+    static void check_new_item(CanvasItem const& item);
+
+    std::vector<CanvasItem>          items_;
+    size_t                           removed_ = 0;
+    std::vector<std::vector<ItemId>> wire_items_;   // per wire, the items showing it
+    std::vector<AtlasInfo>           atlases_;
+    uint32_t                         atlas_revision_ = 0;
+    SpatialGrid<ItemId>              grid_;
+};
+
+#endif //CANVAS_HH
@@ -0,0 +1,233 @@
+#include "canvas_lua.hh"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "luaw/luaw.hh"
+#include "canvas.hh"
+
+// what a query iterator walks: filled once by the query, so no table is created per result
+struct QueryResult {
+    std::vector<ItemId> ids;
+    std::vector<float>  distances;   // nearest queries only
+};
+
+static Canvas* self(lua_State* L)
+{
+    Canvas* canvas = nullptr;
+    luaw_protect(L, [&] { canvas = luaw_to<Canvas*>(L, 1); return 0; });
+    return canvas;
+}
+
+static WireId opt_wire(lua_State* L, int index)
+{
+    return lua_isnoneornil(L, index) ? NO_WIRE : (WireId) luaL_checkinteger(L, index);
+}
+
+static int canvas_atlas(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->set_atlas((AtlasId) luaL_checkinteger(L, 2), luaL_checkstring(L, 3), (int) luaL_checkinteger(L, 4), (int) luaL_checkinteger(L, 5));
+        return 0;
+    });
+}
+
+static int canvas_sprite(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Rect box { (float) luaL_checknumber(L, 2), (float) luaL_checknumber(L, 3), (float) luaL_checknumber(L, 4), (float) luaL_checknumber(L, 5) };
+        lua_pushinteger(L, self(L)->add_sprite(box, (AtlasId) luaL_checkinteger(L, 6), (uint16_t) luaL_checkinteger(L, 7), opt_wire(L, 8)));
+        return 1;
+    });
+}
+
+static int canvas_segment(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        lua_pushinteger(L, self(L)->add_segment((float) luaL_checknumber(L, 2), (float) luaL_checknumber(L, 3),
+                                                (float) luaL_checknumber(L, 4), (float) luaL_checknumber(L, 5),
+                                                (float) luaL_optnumber(L, 7, 1), opt_wire(L, 6)));
+        return 1;
+    });
+}
+
+static int canvas_pin(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        lua_pushinteger(L, self(L)->add_pin((float) luaL_checknumber(L, 2), (float) luaL_checknumber(L, 3), opt_wire(L, 4)));
+        return 1;
+    });
+}
+
+// reads the flat array `field` of the table at index 2, `stride` numbers per item
+static void load_flat(lua_State* L, char const* field, size_t stride, std::vector<CanvasItem>& items, auto make)
+{
+    lua_getfield(L, 2, field);
+    if (!lua_isnil(L, -1)) {
+        luaL_checktype(L, -1, LUA_TTABLE);
+        size_t n = lua_objlen(L, -1);
+        if (n % stride != 0)
+            luaL_error(L, "canvas:load: `%s` must hold %d numbers per item", field, (int) stride);
+        std::vector<double> v(stride);
+        for (size_t i = 0; i < n; i += stride) {
+            for (size_t j = 0; j < stride; ++j) {
+                lua_rawgeti(L, -1, (int) (i + j + 1));
+                if (!lua_isnumber(L, -1))
+                    luaL_error(L, "canvas:load: `%s`[%d] is not a number (got %s)", field, (int) (i + j + 1), lua_typename(L, lua_type(L, -1)));
+                v[j] = lua_tonumber(L, -1);
+                lua_pop(L, 1);
+            }
+            items.push_back(make(v));
+        }
+    }
+    lua_pop(L, 1);
+}
+
+static int canvas_load(lua_State* L)
+{
+    luaL_checktype(L, 2, LUA_TTABLE);
+    auto wire = [](double w) { return w < 0 ? NO_WIRE : (WireId) w; };
+
+    std::vector<CanvasItem> items;
+    load_flat(L, "sprites", 7, items, [&](std::vector<double> const& v) {
+        return CanvasItem { .kind = ItemKind::Sprite, .atlas = (AtlasId) v[4], .tile = (uint16_t) v[5], .wire = wire(v[6]),
+                            .x0 = (float) v[0], .y0 = (float) v[1], .x1 = (float) (v[0] + v[2]), .y1 = (float) (v[1] + v[3]) };
+    });
+    load_flat(L, "segments", 6, items, [&](std::vector<double> const& v) {
+        return CanvasItem { .kind = ItemKind::Segment, .wire = wire(v[5]),
+                            .x0 = (float) v[0], .y0 = (float) v[1], .x1 = (float) v[2], .y1 = (float) v[3], .thickness = (float) v[4] };
+    });
+    load_flat(L, "pins", 3, items, [&](std::vector<double> const& v) {
+        return CanvasItem { .kind = ItemKind::Pin, .wire = wire(v[2]), .x0 = (float) v[0], .y0 = (float) v[1], .x1 = (float) v[0], .y1 = (float) v[1] };
+    });
+
+    return luaw_protect(L, [&] {
+        lua_pushinteger(L, self(L)->add_items(items));
+        return 1;
+    });
+}
+
+static int canvas_move(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->move((ItemId) luaL_checkinteger(L, 2), (float) luaL_checknumber(L, 3), (float) luaL_checknumber(L, 4));
+        return 0;
+    });
+}
+
+static int canvas_remove(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->remove((ItemId) luaL_checkinteger(L, 2));
+        return 0;
+    });
+}
+
+static int canvas_bounds(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Rect b = self(L)->item((ItemId) luaL_checkinteger(L, 2)).bounds();
+        lua_pushnumber(L, b.x);
+        lua_pushnumber(L, b.y);
+        lua_pushnumber(L, b.w);
+        lua_pushnumber(L, b.h);
+        return 4;
+    });
+}
+
+//
+// QUERIES
+//
+
+static int query_next(lua_State* L)
+{
+    auto* result = (QueryResult *) lua_touserdata(L, lua_upvalueindex(1));
+    size_t i = (size_t) lua_tointeger(L, lua_upvalueindex(2));
+    if (i >= result->ids.size())
+        return 0;
+    lua_pushinteger(L, (lua_Integer) i + 1);
+    lua_replace(L, lua_upvalueindex(2));
+
+    lua_pushinteger(L, result->ids[i]);
+    if (result->distances.empty())
+        return 1;
+    lua_pushnumber(L, result->distances[i]);
+    return 2;
+}
+
+static QueryResult* push_query(lua_State* L)
+{
+    auto* result = luaw_push_new_userdata<QueryResult>(L);
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, query_next, 2);
+    return result;
+}
+
+static int canvas_hit(lua_State* L)
+{
+    ItemId id = self(L)->hit((float) luaL_checknumber(L, 2), (float) luaL_checknumber(L, 3), (float) luaL_optnumber(L, 4, 0));
+    if (id == NO_ITEM)
+        lua_pushnil(L);
+    else
+        lua_pushinteger(L, id);
+    return 1;
+}
+
+static int canvas_select(lua_State* L)
+{
+    Rect area { (float) luaL_checknumber(L, 2), (float) luaL_checknumber(L, 3), (float) luaL_checknumber(L, 4), (float) luaL_checknumber(L, 5) };
+    bool contained = lua_toboolean(L, 6);
+    return luaw_protect(L, [&] {
+        QueryResult* result = push_query(L);
+        self(L)->select(area, contained, result->ids);
+        return 1;
+    });
+}
+
+static int canvas_nearest(lua_State* L)
+{
+    float x = (float) luaL_checknumber(L, 2), y = (float) luaL_checknumber(L, 3);
+    lua_Integer k = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, k >= 0, 4, "negative count");
+
+    static char const* kinds[] = { "any", "sprite", "segment", "pin", nullptr };
+    static ItemKind const kind_of[] = { ItemKind::None, ItemKind::Sprite, ItemKind::Segment, ItemKind::Pin };
+    ItemKind kind = kind_of[luaL_checkoption(L, 5, "any", kinds)];
+
+    return luaw_protect(L, [&] {
+        std::vector<std::pair<ItemId, float>> found;
+        self(L)->nearest(x, y, (size_t) k, kind, found);
+        QueryResult* result = push_query(L);
+        for (auto [id, d] : found) {
+            result->ids.push_back(id);
+            result->distances.push_back(d);
+        }
+        return 1;
+    });
+}
+
+static int canvas_count(lua_State* L)
+{
+    lua_pushinteger(L, (lua_Integer) self(L)->item_count());
+    return 1;
+}
+
+void canvas_lua_install(lua_State* L, Canvas* canvas)
+{
+    luaw_set_metatable<Canvas>(L, {
+        { "atlas",   canvas_atlas },
+        { "sprite",  canvas_sprite },
+        { "segment", canvas_segment },
+        { "pin",     canvas_pin },
+        { "load",    canvas_load },
+        { "move",    canvas_move },
+        { "remove",  canvas_remove },
+        { "bounds",  canvas_bounds },
+        { "count",   canvas_count },
+        { "hit",     canvas_hit },
+        { "select",  canvas_select },
+        { "nearest", canvas_nearest },
+    });
+    luaw_setglobal(L, "canvas", canvas);
+}
@@ -0,0 +1,29 @@
+#ifndef CANVAS_LUA_HH
+#define CANVAS_LUA_HH
+
+#include <lua.hpp>
+
+class Canvas;
+
+// Creates the global `canvas`, what the window shows of the circuit (in world units):
+//
+//   canvas:atlas(id, path, tile_w, tile_h)               -- register a texture atlas, loaded once the window is open
+//   canvas:sprite(x, y, w, h, atlas, tile, [wire])       -> id
+//   canvas:segment(x0, y0, x1, y1, [wire], [thickness])  -> id
+//   canvas:pin(x, y, [wire])                             -> id
+//   canvas:load{ sprites={...}, segments={...}, pins={...} }  -> id of the first item
+//          -- bulk load from flat arrays, in this order: x, y, w, h, atlas, tile, wire per sprite; x0, y0, x1, y1,
+//          -- thickness, wire per segment; x, y, wire per pin (wire -1: none)
+//   canvas:move(id, dx, dy)
+//   canvas:remove(id)
+//   canvas:bounds(id)                                    -> x, y, w, h
+//   canvas:count()                                       -> number of items
+//
+//   canvas:hit(x, y, [tolerance])                        -> topmost item under the point, or nil
+//   canvas:select(x, y, w, h, [contained])               -> iterator over the items in the area (or entirely within it)
+//   canvas:nearest(x, y, k, ["sprite"|"segment"|"pin"])  -> iterator over (id, distance) of the k nearest items, nearest first
+//
+//   e.g. for id in canvas:select(0, 0, 100, 100, true) do ... end
+void canvas_lua_install(lua_State* L, Canvas* canvas);
+
+#endif //CANVAS_LUA_HH
@@ -0,0 +1,309 @@
+#include "renderer.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+Renderer::Renderer(Canvas& canvas)
+    : canvas_(canvas)
+{
+    camera_.zoom = 1;
+    camera_.offset = { GetScreenWidth() / 2.0f, GetScreenHeight() / 2.0f };
+}
+
+Renderer::~Renderer()
+{
+    for (auto& [path, texture] : textures_)
+        if (texture.id != 0)
+            UnloadTexture(texture);
+    for (RenderTexture2D& page : pages_)
+        UnloadRenderTexture(page);
+}
+
+//
+// CAMERA
+//
+
+void Renderer::pan(Vector2 screen_delta)
+{
+    camera_.target.x -= screen_delta.x / camera_.zoom;
+    camera_.target.y -= screen_delta.y / camera_.zoom;
+}
+
+void Renderer::zoom(Vector2 screen_point, float factor)
+{
+    Vector2 world = GetScreenToWorld2D(screen_point, camera_);
+    camera_.offset = screen_point;
+    camera_.target = world;
+    camera_.zoom = std::clamp(camera_.zoom * factor, MIN_ZOOM, MAX_ZOOM);
+}
+
+void Renderer::handle_input()
+{
+    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsMouseButtonDown(MOUSE_BUTTON_MIDDLE))
+        pan(GetMouseDelta());
+    float wheel = GetMouseWheelMove();
+    if (wheel != 0)
+        zoom(GetMousePosition(), std::pow(1.2f, wheel));
+}
+
+Rect Renderer::visible_area() const
+{
+    Vector2 top_left = GetScreenToWorld2D({ 0, 0 }, camera_);
+    return { top_left.x, top_left.y, GetScreenWidth() / camera_.zoom, GetScreenHeight() / camera_.zoom };
+}
+
+//
+// FRAME
+//
+
+void Renderer::draw(SimSnapshot const& snapshot)
+{
+    stats_ = {};
+    sync_atlases();
+    track_values(snapshot.values);
+
+    Rect  area = visible_area();
+    float cell_pixels = canvas_.grid().cell_size() * camera_.zoom;
+    float cells_in_view = (GetScreenWidth() / cell_pixels + 1) * (GetScreenHeight() / cell_pixels + 1);
+    stats_.level = cell_pixels >= CHUNK_MIN_PIXELS ? Level::Detail
+                 : cell_pixels >= BLOCK_MIN_PIXELS && cells_in_view <= MAX_CHUNKS / 2 ? Level::Chunks
+                 : Level::Blocks;
+
+    // render textures set their own projection, so they're drawn into before the camera is set
+    if (stats_.level == Level::Chunks)
+        update_chunks(area, snapshot.values);
+
+    BeginMode2D(camera_);
+    switch (stats_.level) {
+        case Level::Detail: draw_items(area, snapshot.values); break;
+        case Level::Chunks: draw_chunks(area); break;
+        case Level::Blocks: draw_blocks(area); break;
+    }
+    EndMode2D();
+
+    stats_.chunks_cached = chunks_.size();
+    ++frame_;
+}
+
+// atlases are registered by the canvas (from Lua, possibly before the window exists) and loaded here
+void Renderer::sync_atlases()
+{
+    if (canvas_.atlas_revision() == atlas_revision_)
+        return;
+    atlas_revision_ = canvas_.atlas_revision();
+
+    auto const& atlases = canvas_.atlases();
+    textures_.resize(atlases.size(), { "", Texture2D {} });
+    for (size_t i = 0; i < atlases.size(); ++i) {
+        auto& [path, texture] = textures_[i];
+        if (path == atlases[i].path)
+            continue;
+        if (texture.id != 0)
+            UnloadTexture(texture);
+        path = atlases[i].path;
+        texture = path.empty() ? Texture2D {} : LoadTexture(path.c_str());   // id 0 if it failed: drawn as outlines
+    }
+    for (auto const& [key, chunk] : chunks_)
+        canvas_.grid().mark_dirty(canvas_.grid().cell_bounds(key));
+}
+
+// marks dirty the cells showing a wire that changed value since the last frame
+void Renderer::track_values(std::vector<uint64_t> const& values)
+{
+    last_values_.resize(values.size(), 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        uint64_t changed = values[i] ^ last_values_[i];
+        while (changed) {
+            WireId w = (WireId) (i * 64 + std::countr_zero(changed));
+            for (ItemId id : canvas_.items_of_wire(w))
+                canvas_.grid().mark_dirty(canvas_.item(id).bounds());
+            changed &= changed - 1;
+        }
+        last_values_[i] = values[i];
+    }
+}
+
+//
+// DETAIL
+//
+
+Color Renderer::wire_color(WireId w, std::vector<uint64_t> const& values, Color on, Color off, Color none) const
+{
+    if (w == NO_WIRE || (w >> 6) >= values.size())
+        return none;
+    return (values[w >> 6] >> (w & 63)) & 1 ? on : off;
+}
+
+void Renderer::draw_items(Rect const& area, std::vector<uint64_t> const& values)
+{
+    // group 0 is the lines and pins (raylib's default texture), group 1 + n is atlas n
+    visible_.clear();
+    canvas_.grid().query(area, [&](ItemId id, Rect const&) {
+        CanvasItem const& item = canvas_.item(id);
+        visible_.emplace_back(item.kind == ItemKind::Sprite ? 1 + (uint32_t) item.atlas : 0, id);
+    });
+    std::sort(visible_.begin(), visible_.end());
+
+    uint32_t group = UINT32_MAX;
+    for (auto [g, id] : visible_) {
+        if (g != group) {
+            group = g;
+            ++stats_.batches;
+        }
+
+        CanvasItem const& item = canvas_.item(id);
+        if (item.kind == ItemKind::Segment) {
+            DrawLineEx({ item.x0, item.y0 }, { item.x1, item.y1 }, item.thickness, wire_color(item.wire, values, LIME, DARKGREEN, GRAY));
+            continue;
+        }
+        if (item.kind == ItemKind::Pin) {
+            float r = Canvas::PIN_RADIUS;
+            DrawRectangleRec({ item.x0 - r, item.y0 - r, 2 * r, 2 * r }, wire_color(item.wire, values, LIME, DARKGREEN, GRAY));
+            continue;
+        }
+
+        Rectangle dest { item.x0, item.y0, item.x1 - item.x0, item.y1 - item.y0 };
+        Texture2D const* texture = item.atlas < textures_.size() ? &textures_[item.atlas].second : nullptr;
+        if (!texture || texture->id == 0) {
+            DrawRectangleLinesEx(dest, 1 / camera_.zoom, wire_color(item.wire, values, LIME, DARKGREEN, GRAY));
+            continue;
+        }
+        AtlasInfo const& atlas = canvas_.atlases()[item.atlas];
+        int columns = std::max(texture->width / atlas.tile_w, 1);
+        Rectangle src { (float) (item.tile % columns * atlas.tile_w), (float) (item.tile / columns * atlas.tile_h),
+                        (float) atlas.tile_w, (float) atlas.tile_h };
+        DrawTexturePro(*texture, src, dest, { 0, 0 }, 0, wire_color(item.wire, values, WHITE, GRAY, WHITE));
+    }
+    stats_.items += visible_.size();
+}
+
+//
+// CHUNKS
+//
+
+Rectangle Renderer::slot_rect(uint32_t slot) const
+{
+    uint32_t index = slot % (CHUNK_PAGE_SLOTS * CHUNK_PAGE_SLOTS);
+    return { (float) (index % CHUNK_PAGE_SLOTS * CHUNK_TEXTURE_SIZE), (float) (index / CHUNK_PAGE_SLOTS * CHUNK_TEXTURE_SIZE),
+             (float) CHUNK_TEXTURE_SIZE, (float) CHUNK_TEXTURE_SIZE };
+}
+
+// a free slot, from a new page while there are fewer than MAX_CHUNKS, or else the one of the chunk drawn the
+// longest ago (but not in this frame)
+bool Renderer::allocate_slot(uint32_t& slot)
+{
+    constexpr uint32_t page_slots = CHUNK_PAGE_SLOTS * CHUNK_PAGE_SLOTS;
+    if (free_slots_.empty() && pages_.size() * page_slots < MAX_CHUNKS) {
+        RenderTexture2D page = LoadRenderTexture(CHUNK_PAGE_SLOTS * CHUNK_TEXTURE_SIZE, CHUNK_PAGE_SLOTS * CHUNK_TEXTURE_SIZE);
+        SetTextureFilter(page.texture, TEXTURE_FILTER_BILINEAR);
+        pages_.push_back(page);
+        for (uint32_t i = page_slots; i > 0; --i)
+            free_slots_.push_back((uint32_t) (pages_.size() - 1) * page_slots + i - 1);
+    }
+
+    if (free_slots_.empty()) {
+        auto oldest = chunks_.end();
+        for (auto it = chunks_.begin(); it != chunks_.end(); ++it)
+            if (it->second.used != frame_ && (oldest == chunks_.end() || it->second.used < oldest->second.used))
+                oldest = it;
+        if (oldest == chunks_.end())
+            return false;
+        free_slots_.push_back(oldest->second.slot);
+        chunks_.erase(oldest);
+    }
+
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    return true;
+}
+
+void Renderer::update_chunks(Rect const& area, std::vector<uint64_t> const& values)
+{
+    float    cell_size = canvas_.grid().cell_size();
+    Camera2D chunk_camera {};
+    chunk_camera.zoom = CHUNK_TEXTURE_SIZE / cell_size;
+
+    canvas_.grid().for_each_existing_cell(area, [&](SpatialGrid<ItemId>::CellKey key, SpatialGrid<ItemId>::Cell const&) {
+        auto* cell = canvas_.grid().find_cell(key);
+        auto  it = chunks_.find(key);
+        if (it != chunks_.end()) {
+            it->second.used = frame_;   // so it isn't the slot given to another cell in view
+            if (!cell->dirty)
+                return;
+        }
+        if (stats_.chunks_rendered == CHUNK_UPDATES_PER_FRAME) {
+            ++stats_.chunks_pending;
+            return;
+        }
+
+        if (it == chunks_.end()) {
+            uint32_t slot;
+            if (!allocate_slot(slot)) {
+                ++stats_.chunks_pending;
+                return;
+            }
+            it = chunks_.emplace(key, Chunk { slot, frame_ }).first;
+        }
+        Rect      bounds = canvas_.grid().cell_bounds(key);
+        Rectangle r = slot_rect(it->second.slot);
+        chunk_camera.target = { bounds.x, bounds.y };
+        chunk_camera.offset = { r.x, r.y };
+
+        // the scissor keeps both the clear and the items overlapping the cell's edges inside the slot
+        BeginTextureMode(pages_[it->second.slot / (CHUNK_PAGE_SLOTS * CHUNK_PAGE_SLOTS)]);
+        BeginScissorMode((int) r.x, (int) r.y, (int) r.width, (int) r.height);
+        ClearBackground(BLANK);
+        BeginMode2D(chunk_camera);
+        draw_items(bounds, values);
+        EndMode2D();
+        EndScissorMode();
+        EndTextureMode();
+
+        cell->dirty = false;
+        ++stats_.chunks_rendered;
+    });
+}
+
+void Renderer::draw_chunks(Rect const& area)
+{
+    // grouped by page, so each page is one batch
+    visible_chunks_.clear();
+    canvas_.grid().for_each_existing_cell(area, [&](SpatialGrid<ItemId>::CellKey key, SpatialGrid<ItemId>::Cell const&) {
+        ++stats_.cells;
+        auto it = chunks_.find(key);
+        if (it == chunks_.end())
+            return;   // not rendered yet
+        it->second.used = frame_;
+        visible_chunks_.emplace_back(it->second.slot, canvas_.grid().cell_bounds(key));
+    });
+    std::sort(visible_chunks_.begin(), visible_chunks_.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    uint32_t page = UINT32_MAX;
+    for (auto const& [slot, b] : visible_chunks_) {
+        if (slot / (CHUNK_PAGE_SLOTS * CHUNK_PAGE_SLOTS) != page) {
+            page = slot / (CHUNK_PAGE_SLOTS * CHUNK_PAGE_SLOTS);
+            ++stats_.batches;
+        }
+        Texture2D texture = pages_[page].texture;
+        Rectangle r = slot_rect(slot);
+        // render textures are stored upside down; half a texel in from the edges so the neighbours don't bleed in
+        Rectangle src { r.x + 0.5f, (float) texture.height - r.y - r.height + 0.5f, r.width - 1, -(r.height - 1) };
+        DrawTexturePro(texture, src, { b.x, b.y, b.w, b.h }, { 0, 0 }, 0, WHITE);
+    }
+}
+
+//
+// BLOCKS
+//
+
+void Renderer::draw_blocks(Rect const& area)
+{
+    canvas_.grid().for_each_existing_cell(area, [&](SpatialGrid<ItemId>::CellKey key, SpatialGrid<ItemId>::Cell const& cell) {
+        ++stats_.cells;
+        Rect b = canvas_.grid().cell_bounds(key);
+        auto density = (unsigned char) std::min<size_t>(64 + cell.entries.size() * 4, 255);
+        DrawRectangleRec({ b.x, b.y, b.w, b.h }, Color { 0, 228, 48, density });
+    });
+    stats_.batches += stats_.cells ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#ifndef RENDERER_HH
+#define RENDERER_HH
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <raylib.h>
+
+#include "canvas.hh"
+#include "sim/sim_thread.hh"
+
+//
+// Draws a Canvas through a pan/zoom camera. Only the grid cells in view are visited, and the visible items
+// are drawn grouped by texture (lines and pins first, then each atlas), so raylib's batcher emits one draw
+// call per group instead of one per switch. The level of detail depends on the size of a grid cell on screen:
+//
+//   Detail  every item, coloured by the value of its wire in the snapshot
+//   Chunks  one cached image per cell; a cell is re-rendered only when it's dirty (its items changed, or a
+//           wire shown in it changed value), a few cells per frame so zooming out never stalls. The images
+//           are slots of a few shared texture pages, reused least recently drawn first, and this level is
+//           only used while the cells in view fit in half the slots (so a big window zoomed out gets Blocks)
+//   Blocks  one rectangle per non-empty cell, shaded by how many items it holds
+//
+// Must be created after the window is open, destroyed before it's closed, and used from the window thread.
+//
+
+class Renderer {
+public:
+    enum class Level : uint8_t { Detail, Chunks, Blocks };
+
+    static constexpr float  CHUNK_MIN_PIXELS = 96;   // cell size on screen below which cached chunks are drawn
+    static constexpr float  BLOCK_MIN_PIXELS = 24;   // ... and below which only blocks are
+    static constexpr int    CHUNK_TEXTURE_SIZE = 128;
+    static constexpr int    CHUNK_PAGE_SLOTS = 16;   // per side, so a page is 2048x2048 (16 MiB)
+    static constexpr size_t CHUNK_UPDATES_PER_FRAME = 32;
+    static constexpr size_t MAX_CHUNKS = 1024;       // cached images, so at most 4 pages
+    static constexpr float  MIN_ZOOM = 1.0f / 4096;
+    static constexpr float  MAX_ZOOM = 64;
+
+    struct Stats {
+        Level  level = Level::Detail;
+        size_t cells = 0;              // visited
+        size_t items = 0;              // drawn
+        size_t batches = 0;            // texture switches
+        size_t chunks_rendered = 0;
+        size_t chunks_pending = 0;     // visible, dirty and left for the next frames
+        size_t chunks_cached = 0;
+    };
+
+    explicit Renderer(Canvas& canvas);
+    Renderer(Renderer const&) = delete;
+    Renderer& operator=(Renderer const&) = delete;
+    ~Renderer();
+
+    Camera2D&       camera()       { return camera_; }
+    Camera2D const& camera() const { return camera_; }
+    void            pan(Vector2 screen_delta);
+    void            zoom(Vector2 screen_point, float factor);   // keeps the world point under `screen_point` in place
+    void            handle_input();                             // right/middle drag pans, the wheel zooms
+
+    void         draw(SimSnapshot const& snapshot);   // between BeginDrawing and EndDrawing
+    Stats const& stats() const { return stats_; }
+
+private:
+    struct Chunk {
+        uint32_t slot;        // page * CHUNK_PAGE_SLOTS^2 + index in the page
+        uint64_t used = 0;    // frame
+    };
+
+    Rect  visible_area() const;
+    void  sync_atlases();
+    void  track_values(std::vector<uint64_t> const& values);
+    void  draw_items(Rect const& area, std::vector<uint64_t> const& values);
+    void  update_chunks(Rect const& area, std::vector<uint64_t> const& values);
+    void  draw_chunks(Rect const& area);
+    void  draw_blocks(Rect const& area);
+    bool  allocate_slot(uint32_t& slot);
+    Rectangle slot_rect(uint32_t slot) const;
+    Color wire_color(WireId w, std::vector<uint64_t> const& values, Color on, Color off, Color none) const;
+
+    Canvas&                                                 canvas_;
+    Camera2D                                                camera_ {};
+    std::vector<std::pair<std::string, Texture2D>>          textures_;   // per atlas: the path loaded, and its texture
+    uint32_t                                                atlas_revision_ = 0;
+    std::unordered_map<SpatialGrid<ItemId>::CellKey, Chunk> chunks_;
+    std::vector<RenderTexture2D>                            pages_;
+    std::vector<uint32_t>                                   free_slots_;
+    std::vector<uint64_t>                                   last_values_;
+    std::vector<std::pair<uint32_t, ItemId>>                visible_;    // (texture group, item)
+    std::vector<std::pair<uint32_t, Rect>>                  visible_chunks_;   // (slot, cell bounds)
+    uint64_t                                                frame_ = 0;
+    Stats                                                   stats_;
+};
+
+#endif //RENDERER_HH
@@ -0,0 +1,106 @@
+#include "batch_sim.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+//
+// SETUP
+//
+
+BatchSimulator::BatchSimulator(Netlist const& netlist, CompiledSimulator& compiled, size_t lanes)
+    : netlist_(netlist), compiled_(compiled), words_(std::max<size_t>(1, (lanes + 63) / 64))
+{
+    sync();
+}
+
+void BatchSimulator::sync()
+{
+    compiled_.compile();
+    if (revision_ == netlist_.revision())
+        return;
+
+    values_.resize(netlist_.wire_count() * words_, 0);
+
+    program_.load(compiled_.program(), words_);
+
+    revision_ = netlist_.revision();
+}
+
+void BatchSimulator::check_wire(WireId w) const
+{
+    if (w >= netlist_.wire_count())
+        throw std::out_of_range("Invalid wire " + std::to_string(w));
+}
+
+//
+// STIMULUS
+//
+
+void BatchSimulator::set(WireId w, bool v)
+{
+    sync();
+    check_wire(w);
+    std::fill_n(values_.begin() + (ptrdiff_t) (w * words_), words_, v ? ~uint64_t(0) : 0);
+}
+
+void BatchSimulator::set(WireId w, std::span<uint64_t const> bits)
+{
+    sync();
+    check_wire(w);
+    size_t n = std::min(bits.size(), words_);
+    std::copy_n(bits.begin(), n, values_.begin() + (ptrdiff_t) (w * words_));
+    std::fill_n(values_.begin() + (ptrdiff_t) (w * words_ + n), words_ - n, 0);
+}
+
+void BatchSimulator::exhaustive(std::span<WireId const> inputs, uint64_t first_vector)
+{
+    static constexpr uint64_t low_patterns[6] = {
+        0xAAAAAAAAAAAAAAAA, 0xCCCCCCCCCCCCCCCC, 0xF0F0F0F0F0F0F0F0,
+        0xFF00FF00FF00FF00, 0xFFFF0000FFFF0000, 0xFFFFFFFF00000000,
+    };
+
+    if (first_vector % 64 != 0)
+        throw std::invalid_argument("The first vector must be a multiple of 64");
+
+    sync();
+    uint64_t first_word = first_vector / 64;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        check_wire(inputs[i]);
+        uint64_t* v = values_.data() + inputs[i] * words_;
+        for (size_t k = 0; k < words_; ++k) {
+            if (i < 6)
+                v[k] = low_patterns[i];
+            else if (i < 70)
+                v[k] = ((first_word + k) >> (i - 6)) & 1 ? ~uint64_t(0) : 0;
+            else
+                v[k] = 0;
+        }
+    }
+}
+
+//
+// EVALUATION
+//
+
+void BatchSimulator::evaluate()
+{
+    sync();
+    program_.run(values_.data());
+}
+
+void BatchSimulator::clock()
+{
+    sync();
+
+    auto registers = compiled_.registers();
+    latched_.resize(registers.size() * words_);
+    for (size_t i = 0; i < registers.size(); ++i) {
+        auto d = get(netlist_.gate_inputs(registers[i])[0]);
+        std::copy(d.begin(), d.end(), latched_.begin() + (ptrdiff_t) (i * words_));
+    }
+    for (size_t i = 0; i < registers.size(); ++i)
+        set(netlist_.gate_output(registers[i]), std::span<uint64_t const>(latched_.data() + i * words_, words_));
+
+    evaluate();
+}
@@ -0,0 +1,57 @@
+#ifndef BATCH_SIM_HH
+#define BATCH_SIM_HH
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "netlist.hh"
+#include "compiled_sim.hh"
+#include "word_program.hh"
+
+//
+// Bit-parallel simulation: every wire holds `lanes` independent values (a multiple of 64), so each
+// instruction of the compiled program evaluates that many input vectors at once with bitwise operations
+// (see WordProgram).
+//
+// Lane `i` of a wire is bit (i % 64) of word (i / 64).
+//
+
+class BatchSimulator {
+public:
+    using Kernel = WordProgram::Kernel;
+
+    BatchSimulator(Netlist const& netlist, CompiledSimulator& compiled, size_t lanes);
+
+    size_t lanes() const { return words_ * 64; }
+    size_t words() const { return words_; }
+    Kernel kernel() const { return program_.kernel(); }
+
+    // stimulus
+
+    void set(WireId w, bool v);                           // same value in every lane
+    void set(WireId w, std::span<uint64_t const> bits);
+    void exhaustive(std::span<WireId const> inputs, uint64_t first_vector = 0);   // lane i gets vector first_vector + i
+
+    // evaluation
+
+    void evaluate();   // settle the combinational logic in every lane
+    void clock();      // registers latch their inputs, then the logic settles
+
+    std::span<uint64_t const> get(WireId w) const { return { values_.data() + (size_t) w * words_, words_ }; }
+    size_t                    wire_count() const { return values_.size() / words_; }
+
+private:
+    void sync();
+    void check_wire(WireId w) const;
+
+    Netlist const&           netlist_;
+    CompiledSimulator&       compiled_;
+    size_t                   words_;
+    std::vector<uint64_t>    values_;     // wire-major: wire w is words [w * words_, (w+1) * words_)
+    std::vector<uint64_t>    latched_;
+    WordProgram              program_;
+    uint64_t                 revision_ = UINT64_MAX;
+};
+
+#endif //BATCH_SIM_HH
@@ -0,0 +1,246 @@
+#include "batch_sim_lua.hh"
+
+#include <bit>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "luaw/luaw.hh"
+#include "batch_sim.hh"
+#include "simulation.hh"
+
+struct Bitset {
+    std::vector<uint64_t> words;
+};
+
+//
+// BITSET
+//
+
+static Bitset* check_bitset(lua_State* L, int index)
+{
+    return (Bitset *) luaL_checkudata(L, index, mt_identifier<Bitset>());
+}
+
+static int push_bitset(lua_State* L, std::vector<uint64_t> words)
+{
+    luaw_push_new_userdata<Bitset>(L, std::move(words));
+    return 1;
+}
+
+static int bitset_len(lua_State* L)
+{
+    return luaw_push(L, check_bitset(L, 1)->words.size() * 64);
+}
+
+static int bitset_test(lua_State* L)
+{
+    Bitset* bs = check_bitset(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, i >= 0 && (size_t) i < bs->words.size() * 64, 2, "lane out of range");
+    return luaw_push(L, (bool) ((bs->words[i / 64] >> (i % 64)) & 1));
+}
+
+static int bitset_count(lua_State* L)
+{
+    size_t n = 0;
+    for (uint64_t w : check_bitset(L, 1)->words)
+        n += std::popcount(w);
+    return luaw_push(L, n);
+}
+
+static int bitset_any(lua_State* L)
+{
+    for (uint64_t w : check_bitset(L, 1)->words)
+        if (w)
+            return luaw_push(L, true);
+    return luaw_push(L, false);
+}
+
+static int bitset_all(lua_State* L)
+{
+    for (uint64_t w : check_bitset(L, 1)->words)
+        if (~w)
+            return luaw_push(L, false);
+    return luaw_push(L, true);
+}
+
+static int bitset_first(lua_State* L)
+{
+    Bitset* bs = check_bitset(L, 1);
+    size_t from = (size_t) luaL_optinteger(L, 2, 0);
+    for (size_t i = from / 64; i < bs->words.size(); ++i) {
+        uint64_t w = bs->words[i];
+        if (i == from / 64)
+            w &= ~uint64_t(0) << (from % 64);
+        if (w)
+            return luaw_push(L, i * 64 + std::countr_zero(w));
+    }
+    return 0;
+}
+
+template <typename F>
+static int bitset_binary(lua_State* L, F op)
+{
+    Bitset* a = check_bitset(L, 1);
+    Bitset* b = check_bitset(L, 2);
+    luaL_argcheck(L, a->words.size() == b->words.size(), 2, "bitsets of different sizes");
+    std::vector<uint64_t> r(a->words.size());
+    for (size_t i = 0; i < r.size(); ++i)
+        r[i] = op(a->words[i], b->words[i]);
+    return push_bitset(L, std::move(r));
+}
+
+static int bitset_band(lua_State* L) { return bitset_binary(L, [](uint64_t a, uint64_t b) { return a & b; }); }
+static int bitset_bor(lua_State* L)  { return bitset_binary(L, [](uint64_t a, uint64_t b) { return a | b; }); }
+static int bitset_bxor(lua_State* L) { return bitset_binary(L, [](uint64_t a, uint64_t b) { return a ^ b; }); }
+
+static int bitset_bnot(lua_State* L)
+{
+    std::vector<uint64_t> r = check_bitset(L, 1)->words;
+    for (uint64_t& w : r)
+        w = ~w;
+    return push_bitset(L, std::move(r));
+}
+
+static int bitset_eq(lua_State* L)
+{
+    return luaw_push(L, check_bitset(L, 1)->words == check_bitset(L, 2)->words);
+}
+
+static int bitset_tostring(lua_State* L)
+{
+    Bitset* bs = check_bitset(L, 1);
+    std::string s;
+    char buf[17];
+    for (size_t i = bs->words.size(); i > 0; --i) {
+        snprintf(buf, sizeof buf, "%016llx", (unsigned long long) bs->words[i - 1]);
+        s += buf;
+    }
+    return luaw_push(L, s);
+}
+
+static int bitset_gc(lua_State* L)
+{
+    check_bitset(L, 1)->~Bitset();
+    return 0;
+}
+
+//
+// BATCH
+//
+
+static BatchSimulator* check_batch(lua_State* L)
+{
+    return (BatchSimulator *) luaL_checkudata(L, 1, mt_identifier<BatchSimulator>());
+}
+
+static WireId check_wire(lua_State* L, BatchSimulator* b, int index)
+{
+    lua_Integer w = luaL_checkinteger(L, index);
+    luaL_argcheck(L, w >= 0 && (size_t) w < b->wire_count(), index, "invalid wire");
+    return (WireId) w;
+}
+
+static int batch_lanes(lua_State* L)
+{
+    return luaw_push(L, check_batch(L)->lanes());
+}
+
+static int batch_kernel(lua_State* L)
+{
+    switch (check_batch(L)->kernel()) {
+        case BatchSimulator::Kernel::AVX512: return luaw_push(L, "avx512");
+        case BatchSimulator::Kernel::AVX2:   return luaw_push(L, "avx2");
+        case BatchSimulator::Kernel::Scalar: break;
+    }
+    return luaw_push(L, "scalar");
+}
+
+static int batch_set(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        BatchSimulator* b = check_batch(L);
+        WireId w = check_wire(L, b, 2);
+        if (lua_isuserdata(L, 3))
+            b->set(w, check_bitset(L, 3)->words);
+        else
+            b->set(w, (bool) lua_toboolean(L, 3));
+        return 0;
+    });
+}
+
+static int batch_exhaustive(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        BatchSimulator* b = check_batch(L);
+        auto inputs = luaw_to<std::vector<WireId>>(L, 2);
+        lua_Integer first = luaL_optinteger(L, 3, 0);
+        luaL_argcheck(L, first >= 0, 3, "invalid first vector");
+        b->exhaustive(inputs, (uint64_t) first);
+        return 0;
+    });
+}
+
+static int batch_evaluate(lua_State* L)
+{
+    return luaw_protect(L, [&] { check_batch(L)->evaluate(); return 0; });
+}
+
+static int batch_clock(lua_State* L)
+{
+    return luaw_protect(L, [&] { check_batch(L)->clock(); return 0; });
+}
+
+static int batch_get(lua_State* L)
+{
+    BatchSimulator* b = check_batch(L);
+    auto bits = b->get(check_wire(L, b, 2));
+    return push_bitset(L, std::vector<uint64_t>(bits.begin(), bits.end()));
+}
+
+static int batch_gc(lua_State* L)
+{
+    check_batch(L)->~BatchSimulator();
+    return 0;
+}
+
+//
+// INSTALLATION
+//
+
+void batch_lua_install(lua_State* L)
+{
+    luaw_set_metatable<Bitset>(L, {
+        { "test",       bitset_test },
+        { "count",      bitset_count },
+        { "any",        bitset_any },
+        { "all",        bitset_all },
+        { "first",      bitset_first },
+        { "band",       bitset_band },
+        { "bor",        bitset_bor },
+        { "bxor",       bitset_bxor },
+        { "bnot",       bitset_bnot },
+        { "__len",      bitset_len },
+        { "__eq",       bitset_eq },
+        { "__tostring", bitset_tostring },
+        { "__gc",       bitset_gc },
+    });
+
+    luaw_set_metatable<BatchSimulator>(L, {
+        { "lanes",      batch_lanes },
+        { "kernel",     batch_kernel },
+        { "set",        batch_set },
+        { "exhaustive", batch_exhaustive },
+        { "evaluate",   batch_evaluate },
+        { "clock",      batch_clock },
+        { "get",        batch_get },
+        { "__gc",       batch_gc },
+    });
+}
+
+int batch_lua_new(lua_State* L, Simulation* simulation, size_t lanes)
+{
+    luaw_push_new_userdata<BatchSimulator>(L, std::cref(simulation->netlist), std::ref(simulation->compiled()), lanes);
+    return 1;
+}
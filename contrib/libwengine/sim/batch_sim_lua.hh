@@ -0,0 +1,24 @@
+#ifndef BATCH_SIM_LUA_HH
+#define BATCH_SIM_LUA_HH
+
+#include <cstddef>
+#include <lua.hpp>
+
+class Simulation;
+
+// Batch simulations are userdata created by `circuit:batch(lanes)`:
+//
+//   batch:lanes(), batch:kernel()             -> number of lanes, "scalar" / "avx2" / "avx512"
+//   batch:set(wire, bool | bitset)
+//   batch:exhaustive({wires}, [first_vector])  -- lane i gets input vector first_vector + i (bit k -> wires[k])
+//   batch:evaluate(), batch:clock()
+//   batch:get(wire)                           -> bitset
+//
+// Results are bitsets (one bit per lane, copied out of the simulation), never per-vector tables:
+//
+//   #bits, bits:test(lane), bits:count(), bits:any(), bits:all(), bits:first([from_lane]) -> lane or nil
+//   bits:band(o), bits:bor(o), bits:bxor(o), bits:bnot(), bits == o, tostring(bits) (hex, lane 0 last)
+void batch_lua_install(lua_State* L);
+int  batch_lua_new(lua_State* L, Simulation* simulation, size_t lanes);
+
+#endif //BATCH_SIM_LUA_HH
@@ -0,0 +1,54 @@
+#ifndef COLUMN_HH
+#define COLUMN_HH
+
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+//
+// One array of a structure-of-arrays, either owned or borrowed from memory that outlives it (e.g. a mapped
+// file). Reading is the same either way; `own` copies borrowed data into an owned vector before the first
+// change (copy on write), so a borrowed column is never written to.
+//
+
+template <typename T>
+class Column {
+public:
+    Column() = default;
+    Column(std::initializer_list<T> init) : owned_(init) {}
+
+    void borrow(std::span<T const> data) {
+        owned_ = {};
+        borrowed_ = data;
+        is_borrowed_ = true;
+    }
+
+    std::vector<T>& own() {
+        if (is_borrowed_) {
+            owned_.assign(borrowed_.begin(), borrowed_.end());
+            borrowed_ = {};
+            is_borrowed_ = false;
+        }
+        return owned_;
+    }
+
+    bool     borrowed() const { return is_borrowed_; }
+    T const* data() const     { return is_borrowed_ ? borrowed_.data() : owned_.data(); }
+    size_t   size() const     { return is_borrowed_ ? borrowed_.size() : owned_.size(); }
+    bool     empty() const    { return size() == 0; }
+    size_t   capacity() const { return owned_.capacity(); }   // owned memory only
+
+    T const& operator[](size_t i) const { return data()[i]; }
+    T const* begin() const { return data(); }
+    T const* end() const   { return data() + size(); }
+
+    operator std::span<T const>() const { return { data(), size() }; }
+
+private:
+    std::vector<T>     owned_;
+    std::span<T const> borrowed_;
+    bool               is_borrowed_ = false;
+};
+
+#endif //COLUMN_HH
@@ -0,0 +1,252 @@
+#include "compiled_sim.hh"
+
+#include <algorithm>
+
+static bool is_combinational(GateType type)
+{
+    return type != GateType::None && type != GateType::Dff;
+}
+
+// truth tables indexed by (a << 1 | b); unary gates use the same wire as both operands
+static void truth_tables(GateType type, uint8_t& partial, uint8_t& final)
+{
+    switch (type) {
+        case GateType::Buf:  partial = final = 0x8; break;
+        case GateType::Not:  partial = final = 0x1; break;
+        case GateType::And:  partial = 0x8; final = 0x8; break;
+        case GateType::Nand: partial = 0x8; final = 0x7; break;
+        case GateType::Or:   partial = 0xE; final = 0xE; break;
+        case GateType::Nor:  partial = 0xE; final = 0x1; break;
+        case GateType::Xor:  partial = 0x6; final = 0x6; break;
+        case GateType::Xnor: partial = 0x6; final = 0x9; break;
+        case GateType::None:
+        case GateType::Dff:  partial = final = 0; break;
+    }
+}
+
+//
+// COMPILATION
+//
+
+void CompiledSimulator::compile()
+{
+    if (revision_ == netlist_.revision())
+        return;
+
+    GateId n = (GateId) netlist_.gate_count();
+    level_.resize(n, 0);
+    value_.resize(netlist_.wire_count(), 0);
+
+    try {
+        if (compiled_gates_ == 0 || n < compiled_gates_ || edit_revision_ != netlist_.edit_revision())
+            rebuild();
+        else
+            append(compiled_gates_);
+    } catch (...) {
+        program_.clear();
+        registers_.clear();
+        compiled_gates_ = 0;
+        revision_ = UINT64_MAX;
+        throw;
+    }
+
+    find_inputs();
+    compiled_gates_ = n;
+    revision_ = netlist_.revision();
+    edit_revision_ = netlist_.edit_revision();
+
+    stats_.instructions = program_.size();
+    stats_.registers = registers_.size();
+    stats_.levels = level_.empty() ? 0 : *std::max_element(level_.begin(), level_.end());
+}
+
+void CompiledSimulator::rebuild()
+{
+    program_.clear();
+    registers_.clear();
+    std::fill(level_.begin(), level_.end(), 0);
+    append(0);
+    ++stats_.rebuilds;
+}
+
+void CompiledSimulator::append(GateId first)
+{
+    GateId n = (GateId) netlist_.gate_count();
+
+    // new gates driving wires read by compiled gates invalidate their position in the program
+    if (first > 0) {
+        for (GateId g = first; g < n; ++g) {
+            for (GateId h : netlist_.fanout(netlist_.gate_output(g))) {
+                if (h < first && is_combinational(netlist_.gate_type(h))) {
+                    rebuild();
+                    return;
+                }
+            }
+        }
+        ++stats_.appends;
+    }
+
+    for (GateId g = first; g < n; ++g)
+        if (netlist_.gate_type(g) == GateType::Dff)
+            registers_.push_back(g);
+
+    levelize(first, n);
+}
+
+// Kahn's algorithm over the combinational gates in [first, last); gates outside the range are already compiled
+void CompiledSimulator::levelize(GateId first, GateId last)
+{
+    auto in_range = [&](GateId g) { return g != NO_GATE && g >= first && g < last && is_combinational(netlist_.gate_type(g)); };
+
+    std::vector<uint32_t> pending(last - first, 0);
+    std::vector<GateId> ready;
+    size_t n_combinational = 0;
+
+    for (GateId g = first; g < last; ++g) {
+        if (!is_combinational(netlist_.gate_type(g)))
+            continue;
+        ++n_combinational;
+        for (WireId w : netlist_.gate_inputs(g))
+            if (in_range(netlist_.wire_driver(w)))
+                ++pending[g - first];
+        if (pending[g - first] == 0)
+            ready.push_back(g);
+    }
+
+    size_t n_emitted = 0;
+    while (!ready.empty()) {
+        GateId g = ready.back();
+        ready.pop_back();
+
+        uint32_t level = 1;
+        for (WireId w : netlist_.gate_inputs(g)) {
+            GateId d = netlist_.wire_driver(w);
+            if (d != NO_GATE && is_combinational(netlist_.gate_type(d)))
+                level = std::max(level, level_[d] + 1);
+        }
+        level_[g] = level;
+        emit(g);
+        ++n_emitted;
+
+        for (GateId h : netlist_.fanout(netlist_.gate_output(g)))
+            if (in_range(h) && --pending[h - first] == 0)
+                ready.push_back(h);
+    }
+
+    if (n_emitted != n_combinational)
+        report_loop(first, last, pending);
+}
+
+void CompiledSimulator::emit(GateId g)
+{
+    uint8_t partial, final;
+    truth_tables(netlist_.gate_type(g), partial, final);
+
+    std::span<WireId const> in = netlist_.gate_inputs(g);
+    WireId out = netlist_.gate_output(g);
+
+    if (in.size() == 1) {
+        program_.push_back({ out, in[0], in[0], final });
+        return;
+    }
+
+    // n-input gates are chained through their own output wire, which nobody reads before the gate is done
+    for (size_t i = 1; i < in.size(); ++i)
+        program_.push_back({ out, i == 1 ? in[0] : out, in[i], i == in.size() - 1 ? final : partial });
+}
+
+void CompiledSimulator::find_inputs()
+{
+    inputs_.clear();
+    for (WireId w = 0; w < netlist_.wire_count(); ++w)
+        if (netlist_.wire_driver(w) == NO_GATE)
+            inputs_.push_back(w);
+}
+
+// every gate still pending has a pending combinational driver, so walking back through them finds a loop
+void CompiledSimulator::report_loop(GateId first, GateId last, std::vector<uint32_t> const& pending) const
+{
+    auto is_pending = [&](GateId g) {
+        return g != NO_GATE && g >= first && g < last && is_combinational(netlist_.gate_type(g)) && pending[g - first] > 0;
+    };
+
+    GateId g = first;
+    while (!is_pending(g))
+        ++g;
+
+    std::vector<GateId> path;
+    std::vector<uint8_t> visited(last - first, 0);
+    while (!visited[g - first]) {
+        visited[g - first] = 1;
+        path.push_back(g);
+        for (WireId w : netlist_.gate_inputs(g)) {
+            if (is_pending(netlist_.wire_driver(w))) {
+                g = netlist_.wire_driver(w);
+                break;
+            }
+        }
+    }
+
+    std::vector<WireId> loop;
+    std::string msg = "Combinational loop through wires";
+    for (auto it = std::find(path.begin(), path.end(), g); it != path.end(); ++it) {
+        loop.push_back(netlist_.gate_output(*it));
+        msg += " " + std::to_string(netlist_.gate_output(*it));
+    }
+    throw CombinationalLoopError(msg, std::move(loop));
+}
+
+//
+// EXECUTION
+//
+
+void CompiledSimulator::reset()
+{
+    reload_ = true;
+}
+
+void CompiledSimulator::run()
+{
+    uint8_t* v = value_.data();
+    for (Instruction const& ins : program_)
+        v[ins.out] = (ins.truth >> (v[ins.a] << 1 | v[ins.b])) & 1;
+}
+
+void CompiledSimulator::step()
+{
+    compile();
+
+    WireValues& values = netlist_.values();
+
+    if (reload_) {
+        for (WireId w = 0; w < value_.size(); ++w)
+            value_[w] = values.get(w);
+        run();   // settle before the first clock edge
+        reload_ = false;
+    } else {
+        for (WireId w : inputs_)
+            value_[w] = values.get(w);
+    }
+
+    // clock edge
+    latched_.resize(registers_.size());
+    for (size_t i = 0; i < registers_.size(); ++i)
+        latched_[i] = value_[netlist_.gate_inputs(registers_[i])[0]];
+    for (size_t i = 0; i < registers_.size(); ++i)
+        value_[netlist_.gate_output(registers_[i])] = latched_[i];
+
+    run();
+
+    // write back, packed
+    uint8_t const* v = value_.data();
+    std::span<uint64_t> words = values.words();
+    size_t n = value_.size();
+    for (size_t i = 0; i < words.size(); ++i) {
+        uint64_t word = 0;
+        size_t base = i * 64;
+        size_t count = std::min<size_t>(64, n - base);
+        for (size_t j = 0; j < count; ++j)
+            word |= uint64_t(v[base + j]) << j;
+        words[i] = word;
+    }
+}
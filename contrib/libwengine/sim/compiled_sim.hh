@@ -0,0 +1,82 @@
+#ifndef COMPILED_SIM_HH
+#define COMPILED_SIM_HH
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "netlist.hh"
+
+struct CombinationalLoopError : public std::runtime_error {
+    CombinationalLoopError(std::string const& msg, std::vector<WireId> wires) : std::runtime_error(msg), loop(std::move(wires)) {}
+    std::vector<WireId> loop;
+};
+
+//
+// Cycle-based simulation of synchronous circuits. The combinational gates are sorted topologically once
+// (registers and circuit inputs are the sources) and flattened into an array of two-input instructions,
+// each with its own truth table, so a cycle is a single branch-free pass over the program.
+//
+// One step is one clock cycle: every Dff latches the value its input settled to in the previous cycle,
+// then the combinational logic settles again.
+//
+// The program is cached; gates appended to the netlist are compiled and appended to it, unless they drive
+// a wire that already compiled gates read, in which case the program is rebuilt.
+//
+
+class CompiledSimulator {
+public:
+    struct Instruction {
+        WireId  out;
+        WireId  a;
+        WireId  b;
+        uint8_t truth;   // out = (truth >> (a << 1 | b)) & 1
+    };
+
+    struct Stats {
+        size_t   instructions = 0;
+        size_t   registers = 0;
+        uint32_t levels = 0;
+        uint64_t rebuilds = 0;
+        uint64_t appends = 0;
+    };
+
+    explicit CompiledSimulator(Netlist& netlist) : netlist_(netlist) {}
+
+    void compile();   // brings the program up to date (throws CombinationalLoopError)
+    void reset();     // reload every wire value from the netlist on the next step
+    void step();
+
+    Stats const& stats() const { return stats_; }
+
+    std::span<Instruction const> program() const { return program_; }     // in topological order
+    std::span<GateId const>      registers() const { return registers_; }
+
+private:
+    void rebuild();
+    void append(GateId first);
+    void levelize(GateId first, GateId last);
+    void emit(GateId g);
+    void find_inputs();
+    void run();
+    [[noreturn]] void report_loop(GateId first, GateId last, std::vector<uint32_t> const& pending) const;
+
+    Netlist&                 netlist_;
+    std::vector<Instruction> program_;
+    std::vector<WireId>      inputs_;      // wires not driven by any gate
+    std::vector<GateId>      registers_;
+    std::vector<uint32_t>    level_;       // per gate
+    std::vector<uint8_t>     value_;       // one byte per wire while running
+    std::vector<uint8_t>     latched_;
+
+    uint64_t revision_ = UINT64_MAX;
+    GateId   compiled_gates_ = 0;
+    uint64_t edit_revision_ = 0;   // changed in place since: rebuild rather than append
+    bool     reload_ = true;
+    Stats    stats_;
+};
+
+#endif //COMPILED_SIM_HH
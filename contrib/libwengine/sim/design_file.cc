@@ -0,0 +1,335 @@
+#include "design_file.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "simulation.hh"
+
+struct FileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t file_size;
+    uint8_t  reserved[40];
+};
+static_assert(sizeof(FileHeader) == 64);
+static_assert(sizeof(DesignFile::Section) == 32);
+
+static constexpr char MAGIC[8] = { 'W', 'T', 'D', 'E', 'S', 'I', 'G', 'N' };
+
+static_assert(std::endian::native == std::endian::little, "design files are only supported on little-endian machines");
+
+//
+// READING
+//
+
+DesignFile::DesignFile(std::string const& path)
+    : path_(path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open '" + path + "'");
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(FileHeader)) {
+        close(fd);
+        throw std::runtime_error("'" + path + "' is not a design file");
+    }
+    size_ = (size_t) st.st_size;
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Could not map '" + path + "'");
+    data_ = (uint8_t const*) data;
+
+    auto fail = [&](std::string const& why) {
+        munmap((void*) data_, size_);
+        throw std::runtime_error("'" + path + "' is not a valid design file: " + why);
+    };
+
+    FileHeader header;
+    std::memcpy(&header, data_, sizeof header);
+    if (std::memcmp(header.magic, MAGIC, sizeof MAGIC) != 0)
+        fail("bad magic");
+    if (header.version != VERSION)
+        fail("version " + std::to_string(header.version) + ", expected " + std::to_string(VERSION));
+    if (header.file_size != size_)
+        fail("truncated");
+    if (header.section_count > (size_ - sizeof(FileHeader)) / sizeof(Section))
+        fail("bad section table");
+
+    sections_.resize(header.section_count);
+    std::memcpy(sections_.data(), data_ + sizeof(FileHeader), header.section_count * sizeof(Section));
+    for (Section const& s : sections_)
+        if (s.offset % ALIGNMENT != 0 || s.offset > size_ || s.size > size_ - s.offset)
+            fail("section out of bounds");
+    std::sort(sections_.begin(), sections_.end(), [](Section const& a, Section const& b) {
+        return std::pair(a.kind, a.index) < std::pair(b.kind, b.index);
+    });
+}
+
+DesignFile::~DesignFile()
+{
+    munmap((void*) data_, size_);
+}
+
+std::pair<uint8_t const*, size_t> DesignFile::section(DesignSection kind, uint32_t index, size_t element_size) const
+{
+    auto key = std::pair((uint32_t) kind, index);
+    auto it = std::lower_bound(sections_.begin(), sections_.end(), key, [](Section const& s, auto const& k) {
+        return std::pair(s.kind, s.index) < k;
+    });
+    if (it == sections_.end() || std::pair(it->kind, it->index) != key)
+        throw std::runtime_error("Design file '" + path_ + "' is missing section " + std::to_string((uint32_t) kind) + "/" + std::to_string(index));
+    if (it->size != it->count * element_size)
+        throw std::runtime_error("Design file '" + path_ + "' has a corrupt section " + std::to_string((uint32_t) kind) + "/" + std::to_string(index));
+    return { data_ + it->offset, it->size };
+}
+
+char const* DesignFile::string(uint32_t offset) const
+{
+    auto strings = array<char>(DesignSection::Strings);
+    if (offset >= strings.size() || !std::memchr(strings.data() + offset, 0, strings.size() - offset))
+        throw std::runtime_error("Design file '" + path_ + "' has a corrupt string table");
+    return strings.data() + offset;
+}
+
+//
+// OPENING
+//
+
+// the netlist doesn't check borrowed arrays, so everything it relies on is checked here
+static NetlistColumns netlist_columns(DesignFile const& file, uint32_t index)
+{
+    NetlistColumns c {
+        .gate_type = file.array<GateType>(DesignSection::GateType, index),
+        .gate_output = file.array<WireId>(DesignSection::GateOutput, index),
+        .gate_delay = file.array<uint32_t>(DesignSection::GateDelay, index),
+        .pin_offset = file.array<uint32_t>(DesignSection::PinOffset, index),
+        .pin_wire = file.array<WireId>(DesignSection::PinWire, index),
+        .wire_driver = file.array<GateId>(DesignSection::WireDriver, index),
+    };
+
+    auto fail = [&](char const* why) {
+        throw std::runtime_error("Netlist " + std::to_string(index) + " of design file '" + file.path() + "' is corrupt: " + why);
+    };
+
+    size_t n_gates = c.gate_type.size(), n_wires = c.wire_driver.size();
+    if (c.gate_output.size() != n_gates || c.gate_delay.size() != n_gates || c.pin_offset.size() != n_gates + 1)
+        fail("gate arrays of different sizes");
+    if (c.pin_offset[0] != 0 || c.pin_offset[n_gates] != c.pin_wire.size())
+        fail("bad pin offsets");
+    for (WireId w : c.pin_wire)
+        if (w >= n_wires)
+            fail("pin out of range");
+
+    for (GateId g = 0; g < n_gates; ++g) {
+        GateType type = c.gate_type[g];
+        if ((uint8_t) type > (uint8_t) GateType::Dff)
+            fail("unknown gate type");
+        if (c.pin_offset[g + 1] < c.pin_offset[g])
+            fail("bad pin offsets");
+        size_t arity = c.pin_offset[g + 1] - c.pin_offset[g];
+        bool unary = type == GateType::Buf || type == GateType::Not || type == GateType::Dff;
+        if (type != GateType::None && (unary ? arity != 1 : arity < 2))
+            fail("bad number of gate inputs");
+        if (c.gate_delay[g] == 0)
+            fail("gate with no delay");
+        if (c.gate_output[g] >= n_wires || c.wire_driver[c.gate_output[g]] != g)
+            fail("gate output out of range or not matching its driver");
+    }
+    for (WireId w = 0; w < n_wires; ++w)
+        if (c.wire_driver[w] != NO_GATE && (c.wire_driver[w] >= n_gates || c.gate_output[c.wire_driver[w]] != w))
+            fail("wire driver not matching its gate");
+
+    return c;
+}
+
+void open_design(Simulation& simulation, std::string const& path)
+{
+    Subcircuits& subcircuits = simulation.subcircuits();
+    if (simulation.netlist.wire_count() != 0 || subcircuits.definition_count() != 0)
+        throw std::logic_error("A design can only be opened into an empty simulation");
+
+    auto file = std::make_shared<DesignFile const>(path);
+
+    // check everything that is read now before changing the simulation
+    NetlistColumns main = netlist_columns(*file, 0);
+    auto values = file->array<uint64_t>(DesignSection::WireValues);
+    auto records = file->array<DesignFile::SubcircuitRecord>(DesignSection::Subcircuits);
+    auto instance_def = file->array<SubcircuitId>(DesignSection::InstanceDef);
+    auto instance_ports = file->array<WireId>(DesignSection::InstancePorts);
+    if (values.size() != (main.wire_driver.size() + 63) / 64)
+        throw std::runtime_error("Design file '" + path + "' has a corrupt value section");
+    size_t n_ports = 0;
+    for (SubcircuitId def : instance_def) {
+        if (def >= records.size())
+            throw std::runtime_error("Design file '" + path + "' has an instance of an unknown subcircuit");
+        n_ports += records[def].inputs + records[def].outputs;
+    }
+    if (n_ports != instance_ports.size())
+        throw std::runtime_error("Design file '" + path + "' has a corrupt instance section");
+    // what `instantiate` would refuse, found only after the netlist is replaced
+    size_t n_wires = main.wire_driver.size();
+    std::vector<uint8_t> driven(n_wires, 0);
+    WireId const* port = instance_ports.data();
+    for (SubcircuitId def : instance_def) {
+        for (uint32_t i = 0; i < records[def].inputs + records[def].outputs; ++i, ++port) {
+            if (*port >= n_wires)
+                throw std::runtime_error("Design file '" + path + "' has an instance port on an invalid wire");
+            if (i < records[def].inputs)
+                continue;
+            if (main.wire_driver[*port] != NO_GATE || driven[*port])
+                throw std::runtime_error("Design file '" + path + "' has an instance output on a wire that is already driven");
+            driven[*port] = 1;
+        }
+    }
+    for (uint32_t n = 0; n < records.size(); ++n) {
+        file->string(records[n].name);
+        if (file->array<WireId>(DesignSection::SubcircuitPorts, n + 1).size() != records[n].inputs + records[n].outputs)
+            throw std::runtime_error("Design file '" + path + "' has a corrupt subcircuit section");
+    }
+
+    // the netlist uses the mapped arrays in place
+    simulation.history().clear();
+    simulation.netlist.borrow(main, file);
+    for (size_t i = 0; i < values.size(); ++i)
+        for (uint64_t bits = values[i]; bits; bits &= bits - 1)
+            simulation.set_value((WireId) (i * 64 + std::countr_zero(bits)), true);
+
+    // subcircuit bodies are only read (and checked) when first used
+    for (uint32_t n = 0; n < records.size(); ++n) {
+        subcircuits.define_lazy(file->string(records[n].name), records[n].inputs, records[n].outputs, [file, n] {
+            auto ports = file->array<WireId>(DesignSection::SubcircuitPorts, n + 1);
+            auto inputs = ports.subspan(0, file->array<DesignFile::SubcircuitRecord>(DesignSection::Subcircuits)[n].inputs);
+            Subcircuits::Body body;
+            body.netlist.borrow(netlist_columns(*file, n + 1), file);
+            body.inputs.assign(inputs.begin(), inputs.end());
+            body.outputs.assign(ports.begin() + (ptrdiff_t) inputs.size(), ports.end());
+            return body;
+        });
+    }
+
+    WireId const* ports = instance_ports.data();
+    for (SubcircuitId def : instance_def) {
+        auto const& r = records[def];
+        subcircuits.instantiate(def, { ports, r.inputs }, { ports + r.inputs, r.outputs });
+        ports += r.inputs + r.outputs;
+    }
+}
+
+//
+// SAVING
+//
+
+struct Pending {
+    DesignSection kind;
+    uint32_t      index;
+    void const*   data;
+    size_t        bytes;
+    size_t        count;
+};
+
+template <typename T>
+static void add(std::vector<Pending>& out, DesignSection kind, uint32_t index, std::span<T const> data)
+{
+    out.push_back({ kind, index, data.data(), data.size_bytes(), data.size() });
+}
+
+static void add_netlist(std::vector<Pending>& out, NetlistColumns const& c, uint32_t index)
+{
+    add(out, DesignSection::GateType, index, c.gate_type);
+    add(out, DesignSection::GateOutput, index, c.gate_output);
+    add(out, DesignSection::GateDelay, index, c.gate_delay);
+    add(out, DesignSection::PinOffset, index, c.pin_offset);
+    add(out, DesignSection::PinWire, index, c.pin_wire);
+    add(out, DesignSection::WireDriver, index, c.wire_driver);
+}
+
+void save_design(Simulation& simulation, std::string const& path)
+{
+    Subcircuits& subcircuits = simulation.subcircuits();
+
+    std::vector<Pending>                      sections;
+    std::string                               strings;
+    std::vector<DesignFile::SubcircuitRecord> records;
+    std::vector<std::vector<WireId>>          def_ports(subcircuits.definition_count());
+    std::vector<SubcircuitId>                 instance_def;
+    std::vector<WireId>                       instance_ports;
+
+    add_netlist(sections, simulation.netlist.columns(), 0);
+    add(sections, DesignSection::WireValues, 0, std::span<uint64_t const>(simulation.netlist.values().words()));
+
+    for (SubcircuitId def = 0; def < subcircuits.definition_count(); ++def) {
+        Subcircuits::Body const& body = subcircuits.body(def);
+        records.push_back({ (uint32_t) strings.size(), (uint32_t) body.inputs.size(), (uint32_t) body.outputs.size() });
+        strings += subcircuits.info(def).name;
+        strings += '\0';
+        def_ports[def] = body.inputs;
+        def_ports[def].insert(def_ports[def].end(), body.outputs.begin(), body.outputs.end());
+        add_netlist(sections, body.netlist.columns(), def + 1);
+        add(sections, DesignSection::SubcircuitPorts, def + 1, std::span<WireId const>(def_ports[def]));
+    }
+    for (InstanceId inst = 0; inst < subcircuits.instance_count(); ++inst) {
+        instance_def.push_back(subcircuits.instance_definition(inst));
+        auto ports = subcircuits.instance_ports(inst);
+        instance_ports.insert(instance_ports.end(), ports.begin(), ports.end());
+    }
+    add(sections, DesignSection::Strings, 0, std::span<char const>(strings));
+    add(sections, DesignSection::Subcircuits, 0, std::span<DesignFile::SubcircuitRecord const>(records));
+    add(sections, DesignSection::InstanceDef, 0, std::span<SubcircuitId const>(instance_def));
+    add(sections, DesignSection::InstancePorts, 0, std::span<WireId const>(instance_ports));
+
+    // layout
+    auto align = [](uint64_t n) { return (n + DesignFile::ALIGNMENT - 1) / DesignFile::ALIGNMENT * DesignFile::ALIGNMENT; };
+    std::vector<DesignFile::Section> table;
+    uint64_t offset = align(sizeof(FileHeader) + sections.size() * sizeof(DesignFile::Section));
+    for (Pending const& p : sections) {
+        table.push_back({ (uint32_t) p.kind, p.index, offset, p.bytes, p.count });
+        offset = align(offset + p.bytes);
+    }
+
+    FileHeader header {};
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = DesignFile::VERSION;
+    header.section_count = (uint32_t) sections.size();
+    header.file_size = offset;
+
+    std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        throw std::runtime_error("Could not open '" + tmp + "' for writing");
+
+    static constexpr uint8_t zeros[DesignFile::ALIGNMENT] {};
+    uint64_t written = 0;
+    auto write = [&](void const* data, size_t n) {
+        if (n > 0 && std::fwrite(data, 1, n, f) != n) {
+            std::fclose(f);
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Error writing design file '" + tmp + "'");
+        }
+        written += n;
+    };
+    auto pad = [&] { write(zeros, align(written) - written); };
+
+    write(&header, sizeof header);
+    write(table.data(), table.size() * sizeof(DesignFile::Section));
+    pad();
+    for (Pending const& p : sections) {
+        write(p.data, p.bytes);
+        pad();
+    }
+
+    if (std::fclose(f) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Error writing design file '" + path + "'");
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef DESIGN_FILE_HH
+#define DESIGN_FILE_HH
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Simulation;
+
+//
+// Binary design file: the main netlist and the subcircuits of a simulation, stored as the arrays the netlist
+// uses, so a design is opened by mapping the file and pointing the netlist at them instead of building it.
+// The mapping is read-only and shared, so processes opening the same design share its pages; only what is
+// later changed gets copied (see Column).
+//
+//   header    "WTDESIGN", version, section count, file size (64 bytes)
+//   table     per section: kind, index, offset, size in bytes, count of elements (32 bytes each)
+//   sections  each aligned to 64 bytes
+//
+// The netlist arrays (gate types, outputs, delays, pin offsets, pin wires, wire drivers) are one section
+// each, with index 0 for the main netlist and 1 + n for the body of subcircuit n. Subcircuit names are in a
+// string table. Subcircuit bodies are only read when first used (see Subcircuits::define_lazy). All numbers
+// are little-endian.
+//
+
+enum class DesignSection : uint32_t {
+    Strings = 1,       // NUL-terminated names
+    GateType,          // uint8_t per gate
+    GateOutput,        // WireId per gate
+    GateDelay,         // uint32_t per gate
+    PinOffset,         // uint32_t per gate, plus one
+    PinWire,           // WireId per pin
+    WireDriver,        // GateId per wire
+    WireValues,        // uint64_t per 64 wires (main netlist only)
+    Subcircuits,       // SubcircuitRecord per definition
+    SubcircuitPorts,   // per definition (index 1 + n): its input, then output, body wires
+    InstanceDef,       // SubcircuitId per instance
+    InstancePorts,     // main netlist wires of every instance, in order: inputs, then outputs
+};
+
+class DesignFile {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t   ALIGNMENT = 64;
+
+    struct SubcircuitRecord {
+        uint32_t name;      // offset in the string table
+        uint32_t inputs;
+        uint32_t outputs;
+        uint32_t reserved = 0;
+    };
+
+    struct Section {
+        uint32_t kind;
+        uint32_t index;
+        uint64_t offset;
+        uint64_t size;      // bytes
+        uint64_t count;     // elements
+    };
+
+    explicit DesignFile(std::string const& path);   // maps the file; throws std::runtime_error if it's not a valid design
+    DesignFile(DesignFile const&) = delete;
+    DesignFile& operator=(DesignFile const&) = delete;
+    ~DesignFile();
+
+    std::string const& path() const { return path_; }
+    size_t             size() const { return size_; }
+
+    template <typename T>
+    std::span<T const> array(DesignSection kind, uint32_t index = 0) const {
+        auto [data, bytes] = section(kind, index, sizeof(T));
+        return { reinterpret_cast<T const*>(data), bytes / sizeof(T) };
+    }
+    char const* string(uint32_t offset) const;
+
+private:
+    std::pair<uint8_t const*, size_t> section(DesignSection kind, uint32_t index, size_t element_size) const;
+
+    std::string          path_;
+    uint8_t const*       data_ = nullptr;
+    size_t               size_ = 0;
+    std::vector<Section> sections_;   // sorted by (kind, index)
+};
+
+// the simulation's subcircuits are all loaded to be saved; the file is written next to `path` and then
+// renamed over it, so a process that has the old file mapped keeps reading the old contents
+void save_design(Simulation& simulation, std::string const& path);
+
+// the simulation must be empty (no wires and no subcircuits); throws std::runtime_error
+void open_design(Simulation& simulation, std::string const& path);
+
+#endif //DESIGN_FILE_HH
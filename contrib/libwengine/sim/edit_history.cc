@@ -0,0 +1,253 @@
+#include "edit_history.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "subcircuit.hh"
+
+//
+// EDITS
+//
+
+WireId EditHistory::add_wires(size_t n)
+{
+    WireId first = netlist_.add_wires(n);
+    start_edit();
+    record({ .op = Op::AddWires, .a = first, .b = (uint32_t) n });
+    end_edit();
+    return first;
+}
+
+GateId EditHistory::add_gate(GateType type, std::span<WireId const> inputs, WireId output, uint32_t delay)
+{
+    if (subcircuits_.drives(output))
+        throw std::invalid_argument("Wire " + std::to_string(output) + " is already driven by a subcircuit instance");
+    GateId g = netlist_.add_gate(type, inputs, output, delay);
+    start_edit();
+    for (size_t i = 0; i < inputs.size(); i += 3) {
+        size_t n = std::min<size_t>(3, inputs.size() - i);
+        record({ .op = Op::Pins, .n = (uint8_t) n, .a = inputs[i], .b = n > 1 ? inputs[i + 1] : 0, .c = n > 2 ? inputs[i + 2] : 0 });
+    }
+    record({ .op = Op::AddGate, .new_type = type, .a = output, .b = delay, .c = (uint32_t) inputs.size() });
+    end_edit();
+    return g;
+}
+
+void EditHistory::set_gate_delay(GateId g, uint32_t delay)
+{
+    uint32_t old = g < netlist_.gate_count() ? netlist_.gate_delay(g) : 0;
+    netlist_.set_gate_delay(g, delay);
+    start_edit();
+    record({ .op = Op::SetDelay, .a = g, .b = old, .c = delay });
+    end_edit();
+}
+
+void EditHistory::set_gate_type(GateId g, GateType type)
+{
+    if (g >= netlist_.gate_count())
+        throw std::out_of_range("Invalid gate " + std::to_string(g));
+    GateType old = netlist_.gate_type(g);
+    if (old == type)
+        return;
+    if (old == GateType::None && subcircuits_.drives(netlist_.gate_output(g)))
+        throw std::invalid_argument("Wire " + std::to_string(netlist_.gate_output(g)) + " is already driven by a subcircuit instance");
+    netlist_.set_gate_type(g, type);
+    start_edit();
+    record({ .op = Op::SetType, .old_type = old, .new_type = type, .a = g });
+    end_edit();
+}
+
+// a new edit makes what was undone unreachable
+void EditHistory::start_edit()
+{
+    undone_.clear();
+    undone_marks_.clear();
+    if (open_ == 0)
+        done_marks_.push_back(dropped_ + done_.size());
+}
+
+void EditHistory::end_edit()
+{
+    if (open_ == 0)
+        trim();
+}
+
+//
+// TRANSACTIONS
+//
+
+void EditHistory::begin()
+{
+    if (open_++ == 0)
+        done_marks_.push_back(dropped_ + done_.size());
+}
+
+void EditHistory::commit()
+{
+    if (open_ == 0)
+        throw std::logic_error("No transaction to commit");
+    if (--open_ == 0) {
+        if (done_marks_.back() == dropped_ + done_.size())
+            done_marks_.pop_back();   // nothing was edited
+        trim();
+    }
+}
+
+bool EditHistory::undo()
+{
+    if (open_ > 0)
+        throw std::logic_error("Can't undo inside a transaction");
+    if (done_marks_.empty())
+        return false;
+
+    size_t start = done_marks_.back() - dropped_;
+    block_.assign(done_.begin() + (ptrdiff_t) start, done_.end());
+    check(block_, true);
+    revert(block_);
+
+    undone_marks_.push_back(undone_.size());
+    undone_.insert(undone_.end(), block_.begin(), block_.end());
+    done_.resize(start);
+    done_marks_.pop_back();
+    return true;
+}
+
+bool EditHistory::redo()
+{
+    if (open_ > 0)
+        throw std::logic_error("Can't redo inside a transaction");
+    if (undone_marks_.empty())
+        return false;
+
+    size_t start = undone_marks_.back();
+    Block block { undone_.data() + start, undone_.size() - start };
+    check(block, false);
+    replay(block);
+
+    done_marks_.push_back(dropped_ + done_.size());
+    done_.insert(done_.end(), block.begin(), block.end());
+    undone_.resize(start);
+    undone_marks_.pop_back();
+    trim();
+    return true;
+}
+
+size_t EditHistory::undo_wire_count() const
+{
+    size_t wires = netlist_.wire_count();
+    if (!done_marks_.empty())
+        for (size_t i = done_marks_.back() - dropped_; i < done_.size(); ++i)
+            if (done_[i].op == Op::AddWires)
+                wires = std::min<size_t>(wires, done_[i].a);
+    return wires;
+}
+
+// Everything the netlist checks holds when edits are undone and redone in order. What it can't know about
+// are the subcircuit instances and the wires added without the history, which aren't part of it, so these
+// are checked before anything is changed, and the transaction is refused as a whole.
+void EditHistory::check(Block block, bool undoing) const
+{
+    // wires are only added and removed at the end of the netlist, where the block must find them
+    size_t wires = netlist_.wire_count();
+    auto check_wires = [&](Edit const& e) {
+        if (e.op != Op::AddWires)
+            return;
+        if (undoing ? e.a + e.b != wires : e.a != wires)
+            throw std::logic_error("Can't " + std::string(undoing ? "undo" : "redo") + ": wires were added since the edit");
+        wires = undoing ? e.a : e.a + e.b;
+    };
+    if (undoing)
+        std::for_each(block.rbegin(), block.rend(), check_wires);
+    else
+        std::for_each(block.begin(), block.end(), check_wires);
+
+    for (Edit const& e : block) {
+        if (undoing && e.op == Op::AddWires && e.a < subcircuits_.port_limit())
+            throw std::logic_error("Can't undo: the wires are used by subcircuit instances");
+
+        bool restores_gate = e.op == Op::SetType && (undoing ? e.new_type == GateType::None : e.old_type == GateType::None);
+        WireId output = e.op == Op::AddGate ? e.a : restores_gate ? netlist_.gate_output(e.a) : NO_WIRE;
+        if ((restores_gate || (e.op == Op::AddGate && !undoing)) && subcircuits_.drives(output))
+            throw std::logic_error("Can't " + std::string(undoing ? "undo" : "redo") + ": wire " + std::to_string(output)
+                                   + " is now driven by a subcircuit instance");
+    }
+}
+
+void EditHistory::revert(Block block)
+{
+    for (auto it = block.rbegin(); it != block.rend(); ++it) {
+        switch (it->op) {
+            case Op::AddWires: netlist_.pop_wires(it->b); break;
+            case Op::AddGate:  netlist_.pop_gate(); break;
+            case Op::Pins:     break;
+            case Op::SetDelay: netlist_.set_gate_delay(it->a, it->b); break;
+            case Op::SetType:  netlist_.set_gate_type(it->a, it->old_type); break;
+        }
+    }
+}
+
+void EditHistory::replay(Block block)
+{
+    pins_.clear();
+    for (Edit const& e : block) {
+        switch (e.op) {
+            case Op::AddWires: netlist_.add_wires(e.b); break;
+            case Op::Pins: {
+                WireId pins[] = { e.a, e.b, e.c };
+                pins_.insert(pins_.end(), pins, pins + e.n);
+                break;
+            }
+            case Op::AddGate:
+                netlist_.add_gate(e.new_type, pins_, e.a, e.b);
+                pins_.clear();
+                break;
+            case Op::SetDelay: netlist_.set_gate_delay(e.a, e.c); break;
+            case Op::SetType:  netlist_.set_gate_type(e.a, e.new_type); break;
+        }
+    }
+}
+
+//
+// HISTORY
+//
+
+void EditHistory::set_depth(size_t depth)
+{
+    depth_ = depth;
+    trim();
+}
+
+// drops the oldest transactions beyond `depth_` (not while one is open, as it may be the oldest)
+void EditHistory::trim()
+{
+    if (open_ > 0)
+        return;
+    while (done_marks_.size() > depth_) {
+        done_marks_.pop_front();
+        size_t end = done_marks_.empty() ? dropped_ + done_.size() : done_marks_.front();
+        done_.erase(done_.begin(), done_.begin() + (ptrdiff_t) (end - dropped_));
+        dropped_ = end;
+    }
+}
+
+void EditHistory::clear()
+{
+    if (open_ > 0)
+        throw std::logic_error("Can't clear the history inside a transaction");
+    dropped_ += done_.size();
+    done_.clear();
+    done_marks_.clear();
+    undone_.clear();
+    undone_marks_.clear();
+}
+
+EditHistory::Stats EditHistory::stats() const
+{
+    return {
+        .undo_steps = done_marks_.size(),
+        .redo_steps = undone_marks_.size(),
+        .edits = done_.size() + undone_.size(),
+        .bytes = (done_.size() + undone_.capacity() + block_.capacity()) * sizeof(Edit)
+               + (done_marks_.size() + undone_marks_.capacity()) * sizeof(size_t) + pins_.capacity() * sizeof(WireId),
+    };
+}
@@ -0,0 +1,107 @@
+#ifndef EDIT_HISTORY_HH
+#define EDIT_HISTORY_HH
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+#include "netlist.hh"
+
+class Subcircuits;
+
+//
+// Undo and redo of netlist edits, kept as a log of operations rather than copies of the netlist: each edit
+// records only what is needed to revert and replay it (16 bytes, plus the pins of an added gate), so the
+// memory used depends on the edits, not on the size of the design.
+//
+// Edits are grouped in transactions, one undo step each: everything between `begin` and the matching
+// `commit` (they nest), or else every single edit. Transactions are the checkpoints of the log: undo and
+// redo move whole transactions between the done and undone logs, and the oldest ones are dropped once there
+// are more than `depth` of them. A new edit clears what was undone.
+//
+// Added wires and gates are reverted by removing them from the end of the netlist, which is possible since
+// edits are undone in the reverse order they were done. Gates are removed from elsewhere by setting their
+// type to None, which keeps their id and pins so the removal can be undone.
+//
+
+class EditHistory {
+public:
+    static constexpr size_t DEFAULT_DEPTH = 1000;
+
+    struct Stats {
+        size_t undo_steps = 0;
+        size_t redo_steps = 0;
+        size_t edits = 0;      // records in both logs
+        size_t bytes = 0;
+    };
+
+    EditHistory(Netlist& netlist, Subcircuits const& subcircuits) : netlist_(netlist), subcircuits_(subcircuits) {}
+
+    // edits (the same as Netlist's, recorded)
+
+    WireId add_wire() { return add_wires(1); }
+    WireId add_wires(size_t n);
+    GateId add_gate(GateType type, std::span<WireId const> inputs, WireId output, uint32_t delay=1);
+    void   set_gate_delay(GateId g, uint32_t delay);
+    void   set_gate_type(GateId g, GateType type);
+    void   remove_gate(GateId g) { set_gate_type(g, GateType::None); }
+
+    // transactions
+
+    void begin();
+    void commit();
+    bool in_transaction() const { return open_ > 0; }
+
+    bool   undo();   // return false if there's nothing to undo/redo
+    bool   redo();
+    size_t undo_wire_count() const;   // of the netlist, after the next undo
+
+    void   set_depth(size_t depth);
+    size_t depth() const { return depth_; }
+    void   clear();
+
+    Stats stats() const;
+
+private:
+    enum class Op : uint8_t { AddWires, AddGate, Pins, SetDelay, SetType };
+
+    // AddWires: a = first wire, b = count
+    // AddGate:  new_type, a = output, b = delay, c = pin count; preceded by ceil(c / 3) Pins records
+    // Pins:     n wires in a, b, c
+    // SetDelay: a = gate, b = old delay, c = new delay
+    // SetType:  a = gate, old_type -> new_type
+    struct Edit {
+        Op       op;
+        GateType old_type = GateType::None;
+        GateType new_type = GateType::None;
+        uint8_t  n = 0;
+        uint32_t a = 0, b = 0, c = 0;
+    };
+    static_assert(sizeof(Edit) == 16);
+
+    using Block = std::span<Edit const>;
+
+    void start_edit();
+    void end_edit();
+    void record(Edit const& e) { done_.push_back(e); }
+    void check(Block block, bool undoing) const;
+    void revert(Block block);
+    void replay(Block block);
+    void trim();
+
+    Netlist&           netlist_;
+    Subcircuits const& subcircuits_;
+
+    std::deque<Edit>    done_;           // oldest first, so dropping old transactions is cheap
+    std::deque<size_t>  done_marks_;     // start of each transaction in done_, plus `dropped_`
+    size_t              dropped_ = 0;    // records dropped from the front of done_
+    std::vector<Edit>   undone_;         // transactions in the order they were undone
+    std::vector<size_t> undone_marks_;
+    std::vector<Edit>   block_;          // the transaction being undone or redone
+    std::vector<WireId> pins_;
+    size_t              open_ = 0;       // nested transactions
+    size_t              depth_ = DEFAULT_DEPTH;
+};
+
+#endif //EDIT_HISTORY_HH
@@ -0,0 +1,81 @@
+#include "event_sim.hh"
+
+#include <algorithm>
+
+void EventSimulator::reset()
+{
+    wheel_.clear();
+    revision_ = UINT64_MAX;
+}
+
+void EventSimulator::reset_metrics()
+{
+    metrics_ = {};
+    metrics_.queue_depth = metrics_.max_queue_depth = wheel_.size();
+}
+
+// after a structural change all gates are evaluated once, since any of them may have new inputs
+void EventSimulator::sync_structure()
+{
+    if (revision_ == netlist_.revision())
+        return;
+
+    is_dirty_.assign(netlist_.gate_count(), 1);
+    dirty_.resize(netlist_.gate_count());
+    for (GateId g = 0; g < netlist_.gate_count(); ++g)
+        dirty_[g] = g;
+
+    revision_ = netlist_.revision();
+}
+
+void EventSimulator::mark(GateId g)
+{
+    if (!is_dirty_[g]) {
+        is_dirty_[g] = 1;
+        dirty_.push_back(g);
+    }
+}
+
+void EventSimulator::wire_changed(WireId w)
+{
+    sync_structure();
+    for (GateId g : netlist_.fanout(w))
+        mark(g);
+}
+
+void EventSimulator::step()
+{
+    sync_structure();
+
+    // evaluate the gates whose inputs changed, with the values of the current tick
+    WireValues const& values = netlist_.values();
+    for (GateId g : dirty_) {
+        is_dirty_[g] = 0;
+        GateType type = netlist_.gate_type(g);
+        if (type == GateType::None)
+            continue;
+        bool v = Netlist::evaluate(type, values, netlist_.gate_inputs(g));
+        wheel_.schedule(wheel_.now() + netlist_.gate_delay(g), { netlist_.gate_output(g), v });
+        ++metrics_.gate_evaluations;
+        ++metrics_.events_scheduled;
+    }
+    dirty_.clear();
+
+    metrics_.queue_depth = wheel_.size();
+    metrics_.max_queue_depth = std::max(metrics_.max_queue_depth, metrics_.queue_depth);
+
+    // advance to the next tick and apply the events that are due
+    due_.clear();
+    wheel_.advance(due_);
+    for (Event const& e : due_) {
+        ++metrics_.events_applied;
+        if (netlist_.value(e.wire) != e.value) {
+            netlist_.values().set(e.wire, e.value);
+            ++metrics_.wire_changes;
+            for (GateId g : netlist_.fanout(e.wire))
+                mark(g);
+        }
+    }
+
+    ++metrics_.steps;
+}
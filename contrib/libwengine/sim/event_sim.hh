@@ -0,0 +1,55 @@
+#ifndef EVENT_SIM_HH
+#define EVENT_SIM_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "netlist.hh"
+#include "timing_wheel.hh"
+
+//
+// Event-driven simulation: only the gates whose inputs changed are evaluated, and their new outputs are
+// scheduled `gate_delay` ticks ahead on a timing wheel. With every delay set to 1, the wire values are
+// identical to the full sweep in `Netlist::step`.
+//
+
+class EventSimulator {
+public:
+    struct Metrics {
+        uint64_t steps = 0;
+        uint64_t gate_evaluations = 0;
+        uint64_t events_scheduled = 0;
+        uint64_t events_applied = 0;
+        uint64_t wire_changes = 0;
+        size_t   queue_depth = 0;
+        size_t   max_queue_depth = 0;
+    };
+
+    explicit EventSimulator(Netlist& netlist) : netlist_(netlist) {}
+
+    void reset();                       // forget pending events and re-evaluate every gate on the next step
+    void wire_changed(WireId w);        // a circuit input was changed from outside
+    void step();
+
+    Metrics const& metrics() const { return metrics_; }
+    void           reset_metrics();
+
+private:
+    struct Event {
+        WireId wire;
+        bool   value;
+    };
+
+    void mark(GateId g);
+    void sync_structure();
+
+    Netlist&                 netlist_;
+    TimingWheel<Event>       wheel_;
+    std::vector<GateId>      dirty_;
+    std::vector<uint8_t>     is_dirty_;
+    std::vector<Event>       due_;
+    uint64_t                 revision_ = UINT64_MAX;
+    Metrics                  metrics_;
+};
+
+#endif //EVENT_SIM_HH
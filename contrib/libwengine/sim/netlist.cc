@@ -0,0 +1,274 @@
+#include "netlist.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+//
+// GATE TYPES
+//
+
+static constexpr struct { GateType type; char const* name; } gate_names[] = {
+    { GateType::None, "none" },
+    { GateType::Buf,  "buf" },
+    { GateType::Not,  "not" },
+    { GateType::And,  "and" },
+    { GateType::Or,   "or" },
+    { GateType::Xor,  "xor" },
+    { GateType::Nand, "nand" },
+    { GateType::Nor,  "nor" },
+    { GateType::Xnor, "xnor" },
+    { GateType::Dff,  "dff" },
+};
+
+GateType gate_type_from_name(std::string const& name)
+{
+    for (auto const& gn : gate_names)
+        if (name == gn.name)
+            return gn.type;
+    throw std::invalid_argument("Unknown gate type '" + name + "'");
+}
+
+char const* gate_type_name(GateType type)
+{
+    for (auto const& gn : gate_names)
+        if (type == gn.type)
+            return gn.name;
+    return "?";
+}
+
+//
+// STRUCTURE
+//
+
+WireId Netlist::add_wire()
+{
+    return add_wires(1);
+}
+
+WireId Netlist::add_wires(size_t n)
+{
+    WireId first = (WireId) wire_driver_.size();
+    wire_driver_.own().resize(wire_driver_.size() + n, NO_GATE);
+    values_.resize(wire_driver_.size());
+    next_.resize(wire_driver_.size());
+    ++revision_;
+    return first;
+}
+
+void Netlist::check_wire(WireId w) const
+{
+    if (w >= wire_driver_.size())
+        throw std::out_of_range("Invalid wire " + std::to_string(w));
+}
+
+GateId Netlist::add_gate(GateType type, std::span<WireId const> inputs, WireId output, uint32_t delay)
+{
+    check_wire(output);
+    for (WireId w : inputs)
+        check_wire(w);
+    if (wire_driver_[output] != NO_GATE)
+        throw std::invalid_argument("Wire " + std::to_string(output) + " is already driven by gate " + std::to_string(wire_driver_[output]));
+
+    size_t arity = inputs.size();
+    bool unary = type == GateType::Buf || type == GateType::Not || type == GateType::Dff;
+    bool ok = unary ? arity == 1 : (type != GateType::None && arity >= 2);
+    if (!ok)
+        throw std::invalid_argument("Invalid number of inputs (" + std::to_string(arity) + ") for gate '" + gate_type_name(type) + "'");
+
+    if (delay == 0)
+        throw std::invalid_argument("Gate delay must be at least one tick");
+
+    GateId g = (GateId) gate_type_.size();
+    gate_type_.own().push_back(type);
+    gate_output_.own().push_back(output);
+    gate_delay_.own().push_back(delay);
+    pin_wire_.own().insert(pin_wire_.own().end(), inputs.begin(), inputs.end());
+    pin_offset_.own().push_back((uint32_t) pin_wire_.size());
+    wire_driver_.own()[output] = g;
+    ++revision_;
+    return g;
+}
+
+void Netlist::set_gate_delay(GateId g, uint32_t delay)
+{
+    if (g >= gate_count())
+        throw std::out_of_range("Invalid gate " + std::to_string(g));
+    if (delay == 0)
+        throw std::invalid_argument("Gate delay must be at least one tick");
+    gate_delay_.own()[g] = delay;
+}
+
+void Netlist::set_gate_type(GateId g, GateType type)
+{
+    if (g >= gate_count())
+        throw std::out_of_range("Invalid gate " + std::to_string(g));
+    GateType old = gate_type_[g];
+    if (type == old)
+        return;
+
+    size_t arity = pin_offset_[g + 1] - pin_offset_[g];
+    bool unary = type == GateType::Buf || type == GateType::Not || type == GateType::Dff;
+    if (type != GateType::None && (unary ? arity != 1 : arity < 2))
+        throw std::invalid_argument("Invalid number of inputs (" + std::to_string(arity) + ") for gate '" + gate_type_name(type) + "'");
+
+    WireId output = gate_output_[g];
+    if (old == GateType::None) {
+        if (wire_driver_[output] != NO_GATE)
+            throw std::invalid_argument("Wire " + std::to_string(output) + " is already driven by gate " + std::to_string(wire_driver_[output]));
+        wire_driver_.own()[output] = g;
+    } else if (type == GateType::None) {
+        wire_driver_.own()[output] = NO_GATE;
+    }
+    gate_type_.own()[g] = type;
+    ++revision_;
+    ++edit_revision_;
+}
+
+void Netlist::pop_gate()
+{
+    if (gate_count() == 0)
+        throw std::logic_error("No gate to remove");
+    GateId g = (GateId) gate_count() - 1;
+    if (gate_type_[g] != GateType::None)
+        wire_driver_.own()[gate_output_[g]] = NO_GATE;
+    gate_type_.own().pop_back();
+    gate_output_.own().pop_back();
+    gate_delay_.own().pop_back();
+    pin_wire_.own().resize(pin_offset_[g]);
+    pin_offset_.own().pop_back();
+    ++revision_;
+    ++edit_revision_;
+}
+
+void Netlist::pop_wires(size_t n)
+{
+    if (n > wire_count())
+        throw std::logic_error("No wires to remove");
+    size_t first = wire_count() - n;
+    for (size_t w = first; w < wire_count(); ++w)
+        if (wire_driver_[w] != NO_GATE)
+            throw std::logic_error("Wire " + std::to_string(w) + " is still driven");
+
+    // cleared, so they start at 0 if they're added again
+    for (size_t w = first; w < wire_count(); ++w) {
+        values_.set((WireId) w, false);
+        next_.set((WireId) w, false);
+    }
+    wire_driver_.own().resize(first);
+    values_.resize(first);
+    next_.resize(first);
+    ++revision_;
+    ++edit_revision_;
+}
+
+void Netlist::borrow(NetlistColumns const& c, std::shared_ptr<void const> owner)
+{
+    gate_type_.borrow(c.gate_type);
+    gate_output_.borrow(c.gate_output);
+    gate_delay_.borrow(c.gate_delay);
+    pin_offset_.borrow(c.pin_offset);
+    pin_wire_.borrow(c.pin_wire);
+    wire_driver_.borrow(c.wire_driver);
+    owner_ = std::move(owner);
+
+    values_ = {};
+    next_ = {};
+    values_.resize(wire_count());
+    next_.resize(wire_count());
+    ++revision_;
+    ++edit_revision_;
+}
+
+bool Netlist::borrowed() const
+{
+    return gate_type_.borrowed() || gate_output_.borrowed() || gate_delay_.borrowed() || pin_offset_.borrowed()
+        || pin_wire_.borrowed() || wire_driver_.borrowed();
+}
+
+NetlistColumns Netlist::columns() const
+{
+    return { gate_type_, gate_output_, gate_delay_, pin_offset_, pin_wire_, wire_driver_ };
+}
+
+std::span<GateId const> Netlist::fanout(WireId w) const
+{
+    if (fanout_revision_ != revision_)
+        build_fanout();
+    return { fanout_gate_.data() + fanout_offset_[w], fanout_offset_[w + 1] - fanout_offset_[w] };
+}
+
+// counting sort of the pins by wire
+void Netlist::build_fanout() const
+{
+    fanout_offset_.assign(wire_count() + 1, 0);
+    for (WireId w : pin_wire_)
+        ++fanout_offset_[w + 1];
+    for (size_t i = 1; i < fanout_offset_.size(); ++i)
+        fanout_offset_[i] += fanout_offset_[i - 1];
+
+    fanout_gate_.resize(pin_wire_.size());
+    std::vector<uint32_t> pos(fanout_offset_.begin(), fanout_offset_.end() - 1);
+    for (GateId g = 0; g < gate_count(); ++g)
+        for (uint32_t p = pin_offset_[g]; p < pin_offset_[g + 1]; ++p)
+            fanout_gate_[pos[pin_wire_[p]]++] = g;
+
+    fanout_revision_ = revision_;
+}
+
+//
+// SIMULATION
+//
+
+bool Netlist::set_value(WireId w, bool v)
+{
+    check_wire(w);
+    bool changed = values_.get(w) != v;
+    values_.set(w, v);
+    return changed;
+}
+
+bool Netlist::evaluate(GateType type, WireValues const& values, std::span<WireId const> inputs)
+{
+    switch (type) {
+        case GateType::Buf:
+        case GateType::Dff:  return values.get(inputs[0]);
+        case GateType::Not:  return !values.get(inputs[0]);
+        case GateType::And:
+        case GateType::Nand: {
+            bool v = true;
+            for (WireId w : inputs)
+                v &= values.get(w);
+            return type == GateType::And ? v : !v;
+        }
+        case GateType::Or:
+        case GateType::Nor: {
+            bool v = false;
+            for (WireId w : inputs)
+                v |= values.get(w);
+            return type == GateType::Or ? v : !v;
+        }
+        case GateType::Xor:
+        case GateType::Xnor: {
+            bool v = false;
+            for (WireId w : inputs)
+                v ^= values.get(w);
+            return type == GateType::Xor ? v : !v;
+        }
+        case GateType::None:
+            break;
+    }
+    return false;
+}
+
+void Netlist::step()
+{
+    std::copy(values_.words().begin(), values_.words().end(), next_.words().begin());
+
+    GateId n = (GateId) gate_count();
+    for (GateId g = 0; g < n; ++g) {
+        if (gate_type_[g] != GateType::None)
+            next_.set(gate_output_[g], evaluate(gate_type_[g], values_, gate_inputs(g)));
+    }
+
+    std::swap(values_, next_);
+}
@@ -0,0 +1,147 @@
+#ifndef NETLIST_HH
+#define NETLIST_HH
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "column.hh"
+
+using WireId = uint32_t;
+using GateId = uint32_t;
+
+constexpr GateId NO_GATE = std::numeric_limits<GateId>::max();
+constexpr WireId NO_WIRE = std::numeric_limits<WireId>::max();
+
+// Dff is a register: in the compiled mode it latches its input once per step (one clock cycle), in the
+// unit-delay modes it behaves as a buffer
+enum class GateType : uint8_t { None, Buf, Not, And, Or, Xor, Nand, Nor, Xnor, Dff };
+
+GateType    gate_type_from_name(std::string const& name);   // throws std::invalid_argument
+char const* gate_type_name(GateType type);
+
+//
+// packed bit array (one bit per wire)
+//
+
+class WireValues {
+public:
+    void resize(size_t n) { words_.resize((n + 63) / 64, 0); }
+
+    bool get(WireId w) const { return (words_[w >> 6] >> (w & 63)) & 1; }
+    void set(WireId w, bool v) {
+        uint64_t mask = uint64_t(1) << (w & 63);
+        words_[w >> 6] = v ? (words_[w >> 6] | mask) : (words_[w >> 6] & ~mask);
+    }
+
+    std::span<uint64_t>       words()       { return words_; }
+    std::span<uint64_t const> words() const { return words_; }
+
+private:
+    std::vector<uint64_t> words_;
+};
+
+// views of the structural arrays of a netlist (see Netlist::borrow)
+struct NetlistColumns {
+    std::span<GateType const> gate_type;
+    std::span<WireId const>   gate_output;
+    std::span<uint32_t const> gate_delay;
+    std::span<uint32_t const> pin_offset;    // gate_count + 1 entries
+    std::span<WireId const>   pin_wire;
+    std::span<GateId const>   wire_driver;
+};
+
+//
+// Gate-level netlist, stored as structure-of-arrays indexed by integer ids. Each gate drives exactly one
+// wire; wires not driven by any gate are circuit inputs and keep the value set by `set_value`.
+// Gate inputs (pins) and wire fanouts are stored in CSR form.
+//
+// The structural arrays may be borrowed from elsewhere (a mapped design file), in which case they are only
+// copied when the structure is first changed; the values are always owned.
+//
+
+class Netlist {
+public:
+    WireId add_wire();
+    WireId add_wires(size_t n);    // returns the first of `n` consecutive ids
+    GateId add_gate(GateType type, std::span<WireId const> inputs, WireId output, uint32_t delay=1);
+    void   set_gate_delay(GateId g, uint32_t delay);
+    void   set_gate_type(GateId g, GateType type);   // None removes the gate (its output is no longer driven)
+
+    // undo the last add_gate / add_wires (the wires must not be driven or read by any gate, which isn't checked)
+    void   pop_gate();
+    void   pop_wires(size_t n);
+
+    // replaces the whole structure with `columns`, which must be consistent (the netlist doesn't check them)
+    // and stay valid while `owner` is alive; every wire starts at 0
+    void           borrow(NetlistColumns const& columns, std::shared_ptr<void const> owner);
+    NetlistColumns columns() const;
+    bool           borrowed() const;   // some of the structure is still borrowed
+
+    // structure
+
+    size_t wire_count() const { return wire_driver_.size(); }
+    size_t gate_count() const { return gate_type_.size(); }
+    size_t pin_count() const  { return pin_wire_.size(); }
+
+    GateType                gate_type(GateId g) const   { return gate_type_[g]; }
+    WireId                  gate_output(GateId g) const { return gate_output_[g]; }
+    uint32_t                gate_delay(GateId g) const  { return gate_delay_[g]; }
+    std::span<WireId const> gate_inputs(GateId g) const {
+        return { pin_wire_.data() + pin_offset_[g], pin_offset_[g + 1] - pin_offset_[g] };
+    }
+    GateId                  wire_driver(WireId w) const { return wire_driver_[w]; }
+    std::span<GateId const> fanout(WireId w) const;
+
+    std::span<GateType const> gate_types() const   { return gate_type_; }
+    std::span<uint32_t const> pin_offsets() const  { return pin_offset_; }
+    std::span<WireId const>   pin_wires() const    { return pin_wire_; }
+    std::span<WireId const>   gate_outputs() const { return gate_output_; }
+
+    uint64_t revision() const { return revision_; }   // incremented on every structural change
+    uint64_t edit_revision() const { return edit_revision_; }   // ... other than adding wires and gates
+
+    // values
+
+    bool              value(WireId w) const { return values_.get(w); }
+    bool              set_value(WireId w, bool v);   // returns true if the value changed
+    WireValues&       values()       { return values_; }
+    WireValues const& values() const { return values_; }
+
+    // full sweep (unit delay: every gate output at tick t+1 is computed from its inputs at tick t)
+
+    void step();
+
+    static bool evaluate(GateType type, WireValues const& values, std::span<WireId const> inputs);
+
+private:
+    void check_wire(WireId w) const;
+    void build_fanout() const;
+
+    // gates
+    Column<GateType> gate_type_;
+    Column<WireId>   gate_output_;
+    Column<uint32_t> gate_delay_;         // in ticks, used by the event-driven simulator
+    Column<uint32_t> pin_offset_ { 0 };   // gate g has pins [pin_offset_[g], pin_offset_[g+1])
+    Column<WireId>   pin_wire_;
+
+    // wires
+    Column<GateId> wire_driver_;
+    WireValues     values_;
+    WireValues     next_;
+
+    std::shared_ptr<void const> owner_;   // of the borrowed columns
+
+    // fanout (CSR, rebuilt lazily after structural changes)
+    mutable std::vector<uint32_t> fanout_offset_;
+    mutable std::vector<GateId>   fanout_gate_;
+    mutable uint64_t              fanout_revision_ = std::numeric_limits<uint64_t>::max();
+
+    uint64_t revision_ = 0;
+    uint64_t edit_revision_ = 0;
+};
+
+#endif //NETLIST_HH
@@ -0,0 +1,86 @@
+#include "parallel_sim.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+ParallelSimulator::ParallelSimulator(Netlist& netlist, size_t threads)
+    : netlist_(netlist), pool_(threads)
+{
+}
+
+void ParallelSimulator::sync()
+{
+    if (revision_ == netlist_.revision())
+        return;
+
+    partition_ = partition_netlist(netlist_, pool_.size() * PARTITIONS_PER_THREAD);
+    partitions_.assign(partition_.gates.size(), {});
+    for (size_t i = 0; i < partitions_.size(); ++i) {
+        partitions_[i].gates = partition_.gates[i].size();
+        partitions_[i].weight = partition_.weight[i];
+        partitions_[i].boundary = partition_.boundary[i];
+    }
+    revision_ = netlist_.revision();
+}
+
+void ParallelSimulator::step()
+{
+    sync();
+
+    WireValues const& values = netlist_.values();
+    next_ = values;
+
+    pool_.run(partition_.gates.size(), [this](size_t part, size_t) { evaluate(part); });
+
+    std::swap(netlist_.values(), next_);
+    ++steps_;
+}
+
+void ParallelSimulator::evaluate(size_t part)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    WireValues const& values = netlist_.values();
+    std::span<uint64_t> next = next_.words();
+
+    for (GateId g : partition_.gates[part]) {
+        GateType type = netlist_.gate_type(g);
+        if (type == GateType::None)
+            continue;
+        WireId out = netlist_.gate_output(g);
+        if (Netlist::evaluate(type, values, netlist_.gate_inputs(g)) != values.get(out))
+            std::atomic_ref<uint64_t>(next[out >> 6]).fetch_xor(uint64_t(1) << (out & 63), std::memory_order_relaxed);
+    }
+
+    partitions_[part].busy_ns += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// METRICS
+//
+
+ParallelSimulator::Metrics ParallelSimulator::metrics() const
+{
+    Metrics m;
+    m.steps = steps_;
+    m.steals = pool_.steals() - steals_at_reset_;
+    m.cut = partition_.cut;
+
+    uint64_t total = 0, busiest = 0;
+    for (auto const& p : partitions_) {
+        total += p.busy_ns;
+        busiest = std::max(busiest, p.busy_ns);
+    }
+    if (total > 0)
+        m.imbalance = (double) busiest * (double) partitions_.size() / (double) total;
+    return m;
+}
+
+void ParallelSimulator::reset_metrics()
+{
+    for (auto& p : partitions_)
+        p.busy_ns = 0;
+    steps_ = 0;
+    steals_at_reset_ = pool_.steals();
+}
@@ -0,0 +1,63 @@
+#ifndef PARALLEL_SIM_HH
+#define PARALLEL_SIM_HH
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "netlist.hh"
+#include "partition.hh"
+#include "thread_pool.hh"
+
+//
+// Multi-threaded unit-delay simulation. The netlist is partitioned by connectivity into several groups per
+// thread, and each step evaluates the groups on a work-stealing pool. Every group reads the values of the
+// previous tick and publishes its outputs into a shared next-tick buffer; the end of the step is the
+// barrier at which the boundary wires become visible to the other groups.
+//
+// Each wire has a single driver, so a changed output is published by flipping its bit with an atomic xor:
+// the result does not depend on the order the groups run in, and is bit-identical to `Netlist::step`.
+//
+
+class ParallelSimulator {
+public:
+    static constexpr size_t PARTITIONS_PER_THREAD = 4;
+
+    struct PartitionMetrics {
+        size_t   gates = 0;
+        size_t   weight = 0;      // pins + gates
+        size_t   boundary = 0;    // wires read by other partitions
+        uint64_t busy_ns = 0;     // time spent evaluating, since the last reset
+    };
+
+    struct Metrics {
+        uint64_t steps = 0;
+        uint64_t steals = 0;
+        size_t   cut = 0;           // total boundary wires
+        double   imbalance = 1.0;   // busiest partition / mean partition
+    };
+
+    ParallelSimulator(Netlist& netlist, size_t threads);
+
+    void step();
+
+    size_t                            threads() const { return pool_.size(); }
+    std::span<PartitionMetrics const> partitions() const { return partitions_; }
+    Metrics                           metrics() const;
+    void                              reset_metrics();
+
+private:
+    void sync();
+    void evaluate(size_t part);
+
+    Netlist&                      netlist_;
+    WorkStealingPool              pool_;
+    NetlistPartition              partition_;
+    std::vector<PartitionMetrics> partitions_;
+    WireValues                    next_;
+    uint64_t                      revision_ = UINT64_MAX;
+    uint64_t                      steps_ = 0;
+    uint64_t                      steals_at_reset_ = 0;
+};
+
+#endif //PARALLEL_SIM_HH
@@ -0,0 +1,148 @@
+#include "partition.hh"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+static constexpr uint32_t UNASSIGNED = UINT32_MAX;
+static constexpr size_t   MAX_NET_FANOUT = 64;     // larger nets (clocks, resets) are ignored when grouping
+static constexpr size_t   REFINE_PASSES = 4;
+
+static size_t gate_weight(Netlist const& netlist, GateId g)
+{
+    return netlist.gate_inputs(g).size() + 1;
+}
+
+// calls f(neighbour) for every gate sharing a wire with `g` (duplicates included)
+template <typename F>
+static void for_each_neighbour(Netlist const& netlist, GateId g, F f)
+{
+    auto visit_net = [&](WireId w) {
+        auto readers = netlist.fanout(w);
+        if (readers.size() > MAX_NET_FANOUT)
+            return;
+        GateId driver = netlist.wire_driver(w);
+        if (driver != NO_GATE && driver != g)
+            f(driver);
+        for (GateId r : readers)
+            if (r != g)
+                f(r);
+    };
+
+    for (WireId w : netlist.gate_inputs(g))
+        visit_net(w);
+    visit_net(netlist.gate_output(g));
+}
+
+static void grow(Netlist const& netlist, size_t n_parts, size_t target, NetlistPartition& p)
+{
+    GateId n_gates = (GateId) netlist.gate_count();
+    uint32_t part = 0;
+    std::deque<GateId> queue;
+
+    // the frontier carries over from one partition to the next, so neighbouring partitions are adjacent
+    for (GateId seed = 0; seed < n_gates; ++seed) {
+        if (p.part_of_gate[seed] != UNASSIGNED)
+            continue;
+        queue.push_back(seed);
+        while (!queue.empty()) {
+            GateId g = queue.front();
+            queue.pop_front();
+            if (p.part_of_gate[g] != UNASSIGNED)
+                continue;
+
+            p.part_of_gate[g] = part;
+            p.weight[part] += gate_weight(netlist, g);
+            if (p.weight[part] >= target && part + 1 < n_parts)
+                ++part;
+
+            for_each_neighbour(netlist, g, [&](GateId nb) {
+                if (p.part_of_gate[nb] == UNASSIGNED)
+                    queue.push_back(nb);
+            });
+        }
+    }
+}
+
+static void refine(Netlist const& netlist, size_t max_weight, NetlistPartition& p)
+{
+    GateId n_gates = (GateId) netlist.gate_count();
+    std::vector<std::pair<uint32_t, uint32_t>> connections;   // (partition, count)
+
+    for (size_t pass = 0; pass < REFINE_PASSES; ++pass) {
+        size_t moves = 0;
+
+        for (GateId g = 0; g < n_gates; ++g) {
+            uint32_t from = p.part_of_gate[g];
+
+            connections.clear();
+            for_each_neighbour(netlist, g, [&](GateId nb) {
+                uint32_t q = p.part_of_gate[nb];
+                auto it = std::find_if(connections.begin(), connections.end(), [q](auto const& c) { return c.first == q; });
+                if (it == connections.end())
+                    connections.emplace_back(q, 1);
+                else
+                    ++it->second;
+            });
+
+            uint32_t internal = 0, best = from, best_count = 0;
+            for (auto [q, count] : connections) {
+                if (q == from)
+                    internal = count;
+                else if (count > best_count)
+                    best = q, best_count = count;
+            }
+
+            size_t w = gate_weight(netlist, g);
+            if (best != from && best_count > internal && p.weight[best] + w <= max_weight && p.weight[from] > w) {
+                p.part_of_gate[g] = best;
+                p.weight[from] -= w;
+                p.weight[best] += w;
+                ++moves;
+            }
+        }
+
+        if (moves == 0)
+            break;
+    }
+}
+
+NetlistPartition partition_netlist(Netlist const& netlist, size_t n_parts)
+{
+    n_parts = std::max<size_t>(1, std::min(n_parts, netlist.gate_count()));
+    GateId n_gates = (GateId) netlist.gate_count();
+
+    NetlistPartition p;
+    p.part_of_gate.assign(n_gates, UNASSIGNED);
+    p.gates.resize(n_parts);
+    p.weight.assign(n_parts, 0);
+    p.boundary.assign(n_parts, 0);
+
+    size_t total = netlist.pin_count() + n_gates;
+    size_t target = (total + n_parts - 1) / n_parts;
+    size_t max_gate = 0;
+    for (GateId g = 0; g < n_gates; ++g)
+        max_gate = std::max(max_gate, gate_weight(netlist, g));
+
+    grow(netlist, n_parts, target, p);
+    refine(netlist, target + target / 20 + max_gate, p);
+
+    for (GateId g = 0; g < n_gates; ++g)
+        p.gates[p.part_of_gate[g]].push_back(g);
+
+    for (WireId w = 0; w < netlist.wire_count(); ++w) {
+        GateId driver = netlist.wire_driver(w);
+        if (driver == NO_GATE)
+            continue;
+        uint32_t owner = p.part_of_gate[driver];
+        for (GateId r : netlist.fanout(w)) {
+            if (p.part_of_gate[r] != owner) {
+                ++p.boundary[owner];
+                ++p.cut;
+                break;
+            }
+        }
+    }
+
+    return p;
+}
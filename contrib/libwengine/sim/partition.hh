@@ -0,0 +1,26 @@
+#ifndef PARTITION_HH
+#define PARTITION_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "netlist.hh"
+
+//
+// Splits the gates of a netlist into `n_parts` connected groups of similar weight (pins + 1 per gate),
+// trying to keep the number of wires crossing between groups low: regions are grown breadth-first over
+// the connectivity, then refined by moving gates to the neighbouring group most of their connections are
+// in (a greedy, Fiduccia-Mattheyses style pass) while the weights stay balanced.
+//
+
+struct NetlistPartition {
+    std::vector<uint32_t>            part_of_gate;
+    std::vector<std::vector<GateId>> gates;      // per partition, in ascending order
+    std::vector<size_t>              weight;     // per partition
+    std::vector<size_t>              boundary;   // per partition: wires driven here and read by another partition
+    size_t                           cut = 0;    // total boundary wires
+};
+
+NetlistPartition partition_netlist(Netlist const& netlist, size_t n_parts);
+
+#endif //PARTITION_HH
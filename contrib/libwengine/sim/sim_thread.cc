@@ -0,0 +1,123 @@
+#include "sim_thread.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+using Clock = std::chrono::steady_clock;
+
+void SimThread::start()
+{
+    if (running())
+        return;
+    stop_ = false;
+    thread_ = std::thread([this] { run(); });
+}
+
+void SimThread::stop()
+{
+    if (!running())
+        return;
+    stop_ = true;
+    thread_.join();
+}
+
+void SimThread::publish(double ticks_per_second, std::string const& error)
+{
+    SimSnapshot& s = snapshots_.back();
+    {
+        std::lock_guard lock(mutex_);
+        s.tick = simulation_.tick();
+        auto words = simulation_.netlist.values().words();
+        s.values.assign(words.begin(), words.end());
+    }
+    s.ticks_per_second = ticks_per_second;
+    s.error = error;
+    snapshots_.publish();
+}
+
+void SimThread::run()
+{
+    auto const batch_time = std::chrono::microseconds(1000);
+    auto const max_sleep = std::chrono::milliseconds(10);
+    auto const publish_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / PUBLISH_PER_SECOND));
+
+    size_t batch = 1;
+    std::string error;
+
+    // rate measurement
+    auto window_start = Clock::now();
+    uint64_t window_ticks = 0;
+    double measured = 0;
+    auto next_publish = Clock::now();
+
+    // rate limiting: ticks are due at paced_start + paced_ticks / rate
+    auto paced_start = Clock::now();
+    uint64_t paced_ticks = 0;
+    double paced_rate = -1;
+
+    auto maybe_publish = [&](Clock::time_point now) {
+        if (now >= next_publish) {
+            publish(paused_ ? 0 : measured, error);
+            next_publish = now + publish_interval;
+        }
+    };
+
+    while (!stop_) {
+        double rate = rate_;
+        auto now = Clock::now();
+
+        if (paused_) {
+            maybe_publish(now);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            paced_rate = -1;
+            continue;
+        }
+
+        if (rate != paced_rate) {   // restart pacing when the rate changes
+            paced_start = now;
+            paced_ticks = 0;
+            paced_rate = rate;
+        }
+
+        size_t n = batch;
+        if (rate > 0) {
+            double due = rate * std::chrono::duration<double>(now - paced_start).count() - (double) paced_ticks;
+            if (due < 1) {
+                maybe_publish(now);
+                auto next = paced_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((double) (paced_ticks + 1) / rate));
+                std::this_thread::sleep_for(std::min<Clock::duration>(next - now, max_sleep));
+                continue;
+            }
+            n = std::min(batch, (size_t) due);
+        }
+
+        try {
+            std::lock_guard lock(mutex_);
+            simulation_.step(n);
+            error.clear();
+        } catch (std::exception& e) {
+            error = e.what();
+            paused_ = true;   // until someone fixes the circuit and resumes
+        }
+        auto t1 = Clock::now();
+
+        // aim for batches of about batch_time, so `mutex` is never held for long
+        if (t1 - now < batch_time / 2)
+            batch = std::min<size_t>(batch * 2, 1 << 24);
+        else if (t1 - now > batch_time * 2)
+            batch = std::max<size_t>(batch / 2, 1);
+
+        window_ticks += n;
+        paced_ticks += n;
+        if (t1 - window_start >= std::chrono::milliseconds(250)) {
+            measured = (double) window_ticks / std::chrono::duration<double>(t1 - window_start).count();
+            window_start = t1;
+            window_ticks = 0;
+        }
+
+        maybe_publish(t1);
+    }
+
+    publish(0, error);
+}
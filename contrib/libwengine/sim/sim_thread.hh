@@ -0,0 +1,64 @@
+#ifndef SIM_THREAD_HH
+#define SIM_THREAD_HH
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "simulation.hh"
+#include "triple_buffer.hh"
+
+// what the render thread sees of the simulation
+struct SimSnapshot {
+    uint64_t              tick = 0;
+    std::vector<uint64_t> values;              // packed wire values (see WireValues)
+    double                ticks_per_second = 0;
+    std::string           error;               // why the simulation paused itself, if it did
+};
+
+//
+// Runs a Simulation on its own thread, in batches of steps sized to take about a millisecond, and publishes
+// a snapshot of it a few hundred times per second through a triple buffer, so a reader never waits for the
+// simulation and the simulation never waits for a reader.
+//
+// Everything else that touches the simulation (e.g. Lua) must hold `mutex`, which the thread only keeps
+// for one batch at a time.
+//
+
+class SimThread {
+public:
+    static constexpr double PUBLISH_PER_SECOND = 240;
+
+    SimThread(Simulation& simulation, std::mutex& mutex) : simulation_(simulation), mutex_(mutex) {}
+    SimThread(SimThread const&) = delete;
+    SimThread& operator=(SimThread const&) = delete;
+    ~SimThread() { stop(); }
+
+    void start();
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+    void   set_rate(double ticks_per_second) { rate_ = ticks_per_second; }   // 0 = as fast as possible
+    double rate() const { return rate_; }
+    void   set_paused(bool paused) { paused_ = paused; }   // the thread also pauses itself if a step throws
+    bool   paused() const { return paused_; }
+
+    SimSnapshot const& snapshot() { return snapshots_.read(); }   // only from one reader thread
+
+private:
+    void run();
+    void publish(double ticks_per_second, std::string const& error);
+
+    Simulation&               simulation_;
+    std::mutex&               mutex_;
+    std::thread               thread_;
+    std::atomic<bool>         stop_ = false;
+    std::atomic<bool>         paused_ = false;
+    std::atomic<double>       rate_ = 0;
+    TripleBuffer<SimSnapshot> snapshots_;
+};
+
+#endif //SIM_THREAD_HH
@@ -0,0 +1,59 @@
+#include "sim_thread_lua.hh"
+
+#include "luaw/luaw.hh"
+#include "sim_thread.hh"
+#include "simulation.hh"
+
+// the thread is an upvalue, as the methods belong to the circuit
+static SimThread* sim_thread(lua_State* L)
+{
+    return (SimThread *) lua_touserdata(L, lua_upvalueindex(1));
+}
+
+static int circuit_run(lua_State* L)
+{
+    SimThread* t = sim_thread(L);
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Number rate = luaL_checknumber(L, 2);
+        luaL_argcheck(L, rate >= 0, 2, "invalid rate");
+        t->set_rate(rate);
+    }
+    t->set_paused(false);
+    return 0;
+}
+
+static int circuit_pause(lua_State* L)
+{
+    sim_thread(L)->set_paused(true);
+    return 0;
+}
+
+static int circuit_paused(lua_State* L)
+{
+    return luaw_push(L, sim_thread(L)->paused());
+}
+
+static int circuit_rate(lua_State* L)
+{
+    return luaw_push(L, sim_thread(L)->rate());
+}
+
+void sim_thread_lua_install(lua_State* L, SimThread* thread)
+{
+    static luaL_Reg const functions[] {
+        { "run",    circuit_run },
+        { "pause",  circuit_pause },
+        { "paused", circuit_paused },
+        { "rate",   circuit_rate },
+        { nullptr, nullptr },
+    };
+
+    luaL_getmetatable(L, mt_identifier<Simulation>());
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        throw std::logic_error("The simulation thread needs the circuit global");
+    }
+    lua_pushlightuserdata(L, thread);
+    luaL_setfuncs(L, functions, 1);
+    lua_pop(L, 1);
+}
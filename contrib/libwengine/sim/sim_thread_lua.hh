@@ -0,0 +1,17 @@
+#ifndef SIM_THREAD_LUA_HH
+#define SIM_THREAD_LUA_HH
+
+#include <lua.hpp>
+
+class SimThread;
+
+// Adds the control of the thread that runs the simulation while the window is open to the global `circuit`
+// (so it must be installed after simulation_lua_install):
+//
+//   circuit:run([rate])    -- resume, at `rate` ticks per second (0 = as fast as possible; by default, the current rate)
+//   circuit:pause()
+//   circuit:paused()       -> true if paused, also after a step raised an error (shown in the window)
+//   circuit:rate()         -> ticks per second, 0 = as fast as possible
+void sim_thread_lua_install(lua_State* L, SimThread* thread);
+
+#endif //SIM_THREAD_LUA_HH
@@ -0,0 +1,111 @@
+#include "simulation.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "wave_recorder.hh"
+
+static constexpr struct { SimMode mode; char const* name; } sim_mode_names[] = {
+    { SimMode::Sweep, "sweep" },
+    { SimMode::Event, "event" },
+    { SimMode::Compiled, "compiled" },
+    { SimMode::Parallel, "parallel" },
+};
+
+SimMode sim_mode_from_name(std::string const& name)
+{
+    for (auto const& mn : sim_mode_names)
+        if (name == mn.name)
+            return mn.mode;
+    throw std::invalid_argument("Unknown simulation mode '" + name + "'");
+}
+
+char const* sim_mode_name(SimMode mode)
+{
+    for (auto const& mn : sim_mode_names)
+        if (mode == mn.mode)
+            return mn.name;
+    return "?";
+}
+
+void Simulation::set_mode(SimMode mode)
+{
+    if (mode == mode_)
+        return;
+    if (mode == SimMode::Event)
+        event_.reset();
+    else if (mode == SimMode::Compiled)
+        compiled_.reset();
+    mode_ = mode;
+}
+
+void Simulation::set_value(WireId w, bool v)
+{
+    if (netlist.set_value(w, v) && mode_ == SimMode::Event)
+        event_.wire_changed(w);
+}
+
+void Simulation::step(size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        switch (mode_) {
+            case SimMode::Sweep: netlist.step(); break;
+            case SimMode::Event: event_.step();  break;
+            case SimMode::Compiled: compiled_.step(); break;
+            case SimMode::Parallel: parallel().step(); break;
+        }
+        if (subcircuits_.instance_count() > 0)
+            step_subcircuits();
+        ++tick_;
+        if (recorder_)
+            recorder_->sample(tick_);
+    }
+}
+
+void Simulation::step_subcircuits()
+{
+    changed_.clear();
+    subcircuits_.step(changed_);
+    if (mode_ == SimMode::Event)
+        for (WireId w : changed_)
+            event_.wire_changed(w);
+}
+
+bool Simulation::undo()
+{
+    if (recorder_ && recorder_->recording())
+        throw std::logic_error("Can't change the circuit while recording waveforms");
+    if (recorder_ && history_.undo_wire_count() < recorder_->watch_limit())
+        throw std::logic_error("Can't undo: it would remove a wire watched by the wave recorder");
+    bool undone = history_.undo();
+    if (undone)
+        event_.reset();   // its queue may hold events for wires that no longer exist
+    return undone;
+}
+
+bool Simulation::redo()
+{
+    if (recorder_ && recorder_->recording())
+        throw std::logic_error("Can't change the circuit while recording waveforms");
+    bool redone = history_.redo();
+    if (redone)
+        event_.reset();
+    return redone;
+}
+
+void Simulation::set_threads(size_t n)
+{
+    if (n == 0)
+        n = std::max(1u, std::thread::hardware_concurrency());
+    if (parallel_ && n != threads_)
+        parallel_.reset();
+    threads_ = n;
+}
+
+ParallelSimulator& Simulation::parallel()
+{
+    if (!parallel_)
+        parallel_ = std::make_unique<ParallelSimulator>(netlist, threads_);
+    return *parallel_;
+}
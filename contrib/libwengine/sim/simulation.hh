@@ -0,0 +1,80 @@
+#ifndef SIMULATION_HH
+#define SIMULATION_HH
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "netlist.hh"
+#include "event_sim.hh"
+#include "compiled_sim.hh"
+#include "edit_history.hh"
+#include "parallel_sim.hh"
+#include "subcircuit.hh"
+
+class WaveRecorder;
+
+enum class SimMode { Sweep, Event, Compiled, Parallel };
+
+SimMode     sim_mode_from_name(std::string const& name);   // throws std::invalid_argument
+char const* sim_mode_name(SimMode mode);
+
+//
+// A netlist together with the engines that can simulate it. Circuit inputs must be changed through
+// `set_value`, so that the event-driven engine knows about them.
+//
+
+class Simulation {
+public:
+    Simulation() : event_(netlist), compiled_(netlist), subcircuits_(netlist) { set_threads(0); }
+
+    void    set_mode(SimMode mode);
+    SimMode mode() const { return mode_; }
+
+    void set_value(WireId w, bool v);
+    bool value(WireId w) const { return netlist.value(w); }
+
+    void     step(size_t n = 1);
+    uint64_t tick() const { return tick_; }
+
+    EventSimulator::Metrics const& event_metrics() const { return event_.metrics(); }
+    void                           reset_metrics() { event_.reset_metrics(); }
+
+    void                            compile() { compiled_.compile(); }
+    CompiledSimulator::Stats const& program_stats() const { return compiled_.stats(); }
+    CompiledSimulator&              compiled() { return compiled_; }
+
+    void               set_threads(size_t n);   // worker threads of the parallel mode (0 = one per core)
+    size_t             threads() const { return threads_; }
+    ParallelSimulator& parallel();
+
+    Subcircuits& subcircuits() { return subcircuits_; }   // evaluated after every step, in any mode
+
+    // edits made through the history can be undone; undo and redo restart the event-driven mode
+    EditHistory& history() { return history_; }
+    bool         undo();
+    bool         redo();
+
+    void set_recorder(WaveRecorder* recorder) { recorder_ = recorder; }   // sampled after every step
+
+    Netlist netlist;
+
+private:
+    void step_subcircuits();
+
+    SimMode           mode_ = SimMode::Sweep;
+    EventSimulator    event_;
+    CompiledSimulator compiled_;
+    uint64_t          tick_ = 0;
+
+    std::unique_ptr<ParallelSimulator> parallel_;   // created on first use, as it starts threads
+    size_t                             threads_;
+
+    Subcircuits         subcircuits_;
+    EditHistory         history_ { netlist, subcircuits_ };
+    std::vector<WireId> changed_;
+    WaveRecorder*       recorder_ = nullptr;
+};
+
+#endif //SIMULATION_HH
@@ -0,0 +1,465 @@
+#include "simulation_lua.hh"
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "luaw/luaw.hh"
+#include "batch_sim_lua.hh"
+#include "design_file.hh"
+#include "simulation.hh"
+
+static Simulation* self(lua_State* L)
+{
+    Simulation* sim = nullptr;
+    luaw_protect(L, [&] { sim = luaw_to<Simulation*>(L, 1); return 0; });
+    return sim;
+}
+
+static WireId check_wire(lua_State* L, Simulation* sim, int index)
+{
+    lua_Integer w = luaL_checkinteger(L, index);
+    luaL_argcheck(L, w >= 0 && (size_t) w < sim->netlist.wire_count(), index, "invalid wire");
+    return (WireId) w;
+}
+
+// `Builder` is a Netlist, or the EditHistory of the circuit so the edits can be undone
+template <typename Builder>
+static int add_wires(lua_State* L, Builder& netlist)
+{
+    return luaw_protect(L, [&] {
+        size_t n = luaw_to<std::optional<size_t>>(L, 2).value_or(1);
+        return luaw_push(L, netlist.add_wires(n));
+    });
+}
+
+template <typename Builder>
+static int add_gate(lua_State* L, Builder& netlist)
+{
+    return luaw_protect(L, [&] {
+        GateType type = gate_type_from_name(luaL_checkstring(L, 2));
+        auto inputs = luaw_to<std::vector<WireId>>(L, 3);
+        auto given_output = luaw_to<std::optional<WireId>>(L, 4);
+        uint32_t delay = luaw_to<std::optional<uint32_t>>(L, 5).value_or(1);
+        WireId output = given_output ? *given_output : netlist.add_wire();
+        netlist.add_gate(type, inputs, output, delay);
+        return luaw_push(L, output);
+    });
+}
+
+static int circuit_wire(lua_State* L) { return add_wires(L, self(L)->history()); }
+static int circuit_gate(lua_State* L) { return add_gate(L, self(L)->history()); }
+
+// the body of a subcircuit being defined, only valid during the call to its function in `circuit:define`
+static Netlist& definition_body(lua_State* L)
+{
+    Netlist* netlist = nullptr;
+    luaw_protect(L, [&] { netlist = luaw_to<Netlist*>(L, 1); return 0; });
+    if (!netlist)
+        luaL_error(L, "The body of a subcircuit can only be used while it's being defined");
+    return *netlist;
+}
+
+static int body_wire(lua_State* L) { return add_wires(L, definition_body(L)); }
+static int body_gate(lua_State* L) { return add_gate(L, definition_body(L)); }
+
+// upvalue: the simulation, whose definitions can be used
+static int body_instance(lua_State* L)
+{
+    Netlist& body = definition_body(L);
+    Simulation* sim = (Simulation *) lua_touserdata(L, lua_upvalueindex(1));
+    return luaw_protect(L, [&] {
+        SubcircuitId def = (SubcircuitId) luaL_checkinteger(L, 2);
+        auto inputs = luaw_to<std::vector<WireId>>(L, 3);
+        std::vector<WireId> outputs = sim->subcircuits().flatten(def, body, inputs);
+        luaL_checkstack(L, (int) outputs.size(), "too many outputs");
+        for (WireId w : outputs)
+            luaw_push(L, w);
+        return (int) outputs.size();
+    });
+}
+
+static GateId check_driver(lua_State* L, Simulation* sim, int index)
+{
+    GateId g = sim->netlist.wire_driver(check_wire(L, sim, index));
+    if (g == NO_GATE)
+        throw std::invalid_argument("Wire is not driven by a gate");
+    return g;
+}
+
+static int circuit_delay(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Simulation* sim = self(L);
+        lua_Integer delay = luaL_checkinteger(L, 3);
+        luaL_argcheck(L, delay >= 0 && delay <= UINT32_MAX, 3, "invalid delay");
+        sim->history().set_gate_delay(check_driver(L, sim, 2), (uint32_t) delay);
+        return 0;
+    });
+}
+
+static int circuit_retype(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Simulation* sim = self(L);
+        sim->history().set_gate_type(check_driver(L, sim, 2), gate_type_from_name(luaL_checkstring(L, 3)));
+        return 0;
+    });
+}
+
+static int circuit_remove(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Simulation* sim = self(L);
+        sim->history().remove_gate(check_driver(L, sim, 2));
+        return 0;
+    });
+}
+
+static int circuit_set(lua_State* L)
+{
+    Simulation* sim = self(L);
+    sim->set_value(check_wire(L, sim, 2), lua_toboolean(L, 3));
+    return 0;
+}
+
+static int circuit_get(lua_State* L)
+{
+    Simulation* sim = self(L);
+    return luaw_push(L, sim->value(check_wire(L, sim, 2)));
+}
+
+static int circuit_mode(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Simulation* sim = self(L);
+        if (!lua_isnoneornil(L, 2))
+            sim->set_mode(sim_mode_from_name(luaL_checkstring(L, 2)));
+        return luaw_push(L, sim_mode_name(sim->mode()));
+    });
+}
+
+static int circuit_step(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        lua_Integer steps = luaL_optinteger(L, 2, 1);
+        luaL_argcheck(L, steps >= 0, 2, "negative number of steps");
+        self(L)->step((size_t) steps);
+        return 0;
+    });
+}
+
+static int circuit_compile(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->compile();
+        return 0;
+    });
+}
+
+static int circuit_program(lua_State* L)
+{
+    auto const& st = self(L)->program_stats();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "instructions", st.instructions);
+    luaw_setfield(L, -1, "registers", st.registers);
+    luaw_setfield(L, -1, "levels", st.levels);
+    luaw_setfield(L, -1, "rebuilds", st.rebuilds);
+    luaw_setfield(L, -1, "appends", st.appends);
+    return 1;
+}
+
+static int circuit_batch(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        lua_Integer lanes = luaL_checkinteger(L, 2);
+        if (lanes <= 0)
+            throw std::invalid_argument("The number of lanes must be positive");
+        return batch_lua_new(L, self(L), (size_t) lanes);
+    });
+}
+
+static int circuit_threads(lua_State* L)
+{
+    Simulation* sim = self(L);
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer n = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, n >= 0, 2, "invalid number of threads");
+        sim->set_threads((size_t) n);
+    }
+    return luaw_push(L, sim->threads());
+}
+
+static int circuit_partitions(lua_State* L)
+{
+    ParallelSimulator& par = self(L)->parallel();
+    auto m = par.metrics();
+    auto partitions = par.partitions();
+
+    uint64_t total_ns = 0;
+    for (auto const& p : partitions)
+        total_ns += p.busy_ns;
+    double mean_ns = partitions.empty() ? 0.0 : (double) total_ns / (double) partitions.size();
+
+    lua_newtable(L);
+    luaw_setfield(L, -1, "steps", m.steps);
+    luaw_setfield(L, -1, "steals", m.steals);
+    luaw_setfield(L, -1, "cut", m.cut);
+    luaw_setfield(L, -1, "imbalance", m.imbalance);
+    luaw_setfield(L, -1, "threads", par.threads());
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        auto const& p = partitions[i];
+        lua_newtable(L);
+        luaw_setfield(L, -1, "gates", p.gates);
+        luaw_setfield(L, -1, "weight", p.weight);
+        luaw_setfield(L, -1, "boundary", p.boundary);
+        luaw_setfield(L, -1, "busy_ns", p.busy_ns);
+        luaw_setfield(L, -1, "load", mean_ns > 0 ? (double) p.busy_ns / mean_ns : 1.0);   // 1.0 = average
+        lua_rawseti(L, -2, (int) i + 1);
+    }
+
+    if (lua_toboolean(L, 2))
+        par.reset_metrics();
+    return 1;
+}
+
+static int circuit_define(lua_State* L)
+{
+    Simulation* sim = self(L);
+    std::string name = luaL_checkstring(L, 2);
+    lua_Integer n_inputs = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, n_inputs >= 0, 3, "invalid number of inputs");
+    luaL_checktype(L, 4, LUA_TFUNCTION);
+    luaL_checkstack(L, (int) n_inputs + 3, "too many inputs");
+
+    Netlist body;
+    std::vector<WireId> inputs;
+    for (lua_Integer i = 0; i < n_inputs; ++i)
+        inputs.push_back(body.add_wire());
+
+    // fn(body, inputs...) -> outputs...
+    int top = lua_gettop(L);
+    luaw_push(L, &body);
+    lua_pushvalue(L, 4);
+    lua_pushvalue(L, top + 1);
+    for (WireId w : inputs)
+        luaw_push(L, w);
+    int status = lua_pcall(L, (int) n_inputs + 1, LUA_MULTRET, 0);
+
+    // whatever kept the body (a closure, a global) must not reach the netlist once it's gone
+    lua_pushnil(L);
+    lua_setfield(L, top + 1, "__ptr");
+    if (status != 0)
+        return lua_error(L);
+
+    std::vector<WireId> outputs;
+    for (int i = top + 2; i <= lua_gettop(L); ++i)
+        outputs.push_back((WireId) luaL_checkinteger(L, i));
+    lua_settop(L, top);
+
+    return luaw_protect(L, [&] {
+        return luaw_push(L, sim->subcircuits().define(name, std::move(body), std::move(inputs), std::move(outputs)));
+    });
+}
+
+static int circuit_instance(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        Simulation* sim = self(L);
+        SubcircuitId def = (SubcircuitId) luaL_checkinteger(L, 2);
+        auto inputs = luaw_to<std::vector<WireId>>(L, 3);
+
+        std::vector<WireId> outputs;
+        if (lua_isnoneornil(L, 4)) {
+            // what `instantiate` checks of the inputs, before the outputs are created, so a bad call leaves no wires
+            auto info = sim->subcircuits().info(def);
+            if (inputs.size() != info.inputs)
+                throw std::invalid_argument("Subcircuit '" + info.name + "' has " + std::to_string(info.inputs) + " inputs");
+            for (WireId w : inputs)
+                if (w >= sim->netlist.wire_count())
+                    throw std::out_of_range("Invalid wire " + std::to_string(w));
+
+            WireId first = sim->history().add_wires(info.outputs);
+            for (size_t i = 0; i < info.outputs; ++i)
+                outputs.push_back(first + (WireId) i);
+        } else {
+            outputs = luaw_to<std::vector<WireId>>(L, 4);
+        }
+
+        InstanceId id = sim->subcircuits().instantiate(def, inputs, outputs);
+        luaL_checkstack(L, (int) outputs.size() + 1, "too many outputs");
+        luaw_push(L, id);
+        for (WireId w : outputs)
+            luaw_push(L, w);
+        return (int) outputs.size() + 1;
+    });
+}
+
+static int circuit_probe(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        auto& subcircuits = self(L)->subcircuits();
+        return luaw_push(L, subcircuits.probe((InstanceId) luaL_checkinteger(L, 2), (WireId) luaL_checkinteger(L, 3)));
+    });
+}
+
+static int circuit_subcircuits(lua_State* L)
+{
+    auto const& subcircuits = self(L)->subcircuits();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "instances", subcircuits.instance_count());
+    luaw_setfield(L, -1, "memory", subcircuits.memory());
+    for (SubcircuitId def = 0; def < subcircuits.definition_count(); ++def) {
+        auto info = subcircuits.info(def);
+        lua_newtable(L);
+        luaw_setfield(L, -1, "name", info.name);
+        luaw_setfield(L, -1, "inputs", info.inputs);
+        luaw_setfield(L, -1, "outputs", info.outputs);
+        luaw_setfield(L, -1, "wires", info.wires);
+        luaw_setfield(L, -1, "instructions", info.instructions);
+        luaw_setfield(L, -1, "registers", info.registers);
+        luaw_setfield(L, -1, "instances", info.instances);
+        luaw_setfield(L, -1, "loaded", info.loaded);
+        lua_rawseti(L, -2, (int) def + 1);
+    }
+    return 1;
+}
+
+static int circuit_stats(lua_State* L)
+{
+    Simulation* sim = self(L);
+    lua_newtable(L);
+    luaw_setfield(L, -1, "wires", sim->netlist.wire_count());
+    luaw_setfield(L, -1, "gates", sim->netlist.gate_count());
+    luaw_setfield(L, -1, "pins", sim->netlist.pin_count());
+    luaw_setfield(L, -1, "tick", sim->tick());
+    return 1;
+}
+
+static int circuit_save(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        save_design(*self(L), luaL_checkstring(L, 2));
+        return 0;
+    });
+}
+
+static int circuit_open(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        open_design(*self(L), luaL_checkstring(L, 2));
+        return 0;
+    });
+}
+
+//
+// HISTORY
+//
+
+static int circuit_begin(lua_State* L)
+{
+    self(L)->history().begin();
+    return 0;
+}
+
+static int circuit_commit(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->history().commit();
+        return 0;
+    });
+}
+
+static int circuit_undo(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        return luaw_push(L, self(L)->undo());
+    });
+}
+
+static int circuit_redo(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        return luaw_push(L, self(L)->redo());
+    });
+}
+
+static int circuit_history(lua_State* L)
+{
+    EditHistory& history = self(L)->history();
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer depth = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, depth >= 0, 2, "negative depth");
+        history.set_depth((size_t) depth);
+    }
+    auto st = history.stats();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "undo", st.undo_steps);
+    luaw_setfield(L, -1, "redo", st.redo_steps);
+    luaw_setfield(L, -1, "edits", st.edits);
+    luaw_setfield(L, -1, "bytes", st.bytes);
+    luaw_setfield(L, -1, "depth", history.depth());
+    return 1;
+}
+
+static int circuit_metrics(lua_State* L)
+{
+    Simulation* sim = self(L);
+    auto const& m = sim->event_metrics();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "steps", m.steps);
+    luaw_setfield(L, -1, "gate_evaluations", m.gate_evaluations);
+    luaw_setfield(L, -1, "events_scheduled", m.events_scheduled);
+    luaw_setfield(L, -1, "events_applied", m.events_applied);
+    luaw_setfield(L, -1, "wire_changes", m.wire_changes);
+    luaw_setfield(L, -1, "queue_depth", m.queue_depth);
+    luaw_setfield(L, -1, "max_queue_depth", m.max_queue_depth);
+    if (lua_toboolean(L, 2))
+        sim->reset_metrics();
+    return 1;
+}
+
+void simulation_lua_install(lua_State* L, Simulation* simulation)
+{
+    luaw_set_metatable<Netlist>(L, {
+        { "wire", body_wire },
+        { "gate", body_gate },
+    });
+    luaL_getmetatable(L, mt_identifier<Netlist>());
+    lua_pushlightuserdata(L, simulation);
+    lua_pushcclosure(L, body_instance, 1);
+    lua_setfield(L, -2, "instance");
+    lua_pop(L, 1);
+    luaw_set_metatable<Simulation>(L, {
+        { "wire",        circuit_wire },
+        { "gate",        circuit_gate },
+        { "delay",       circuit_delay },
+        { "retype",      circuit_retype },
+        { "remove",      circuit_remove },
+        { "set",         circuit_set },
+        { "get",         circuit_get },
+        { "mode",        circuit_mode },
+        { "step",        circuit_step },
+        { "compile",     circuit_compile },
+        { "program",     circuit_program },
+        { "batch",       circuit_batch },
+        { "threads",     circuit_threads },
+        { "partitions",  circuit_partitions },
+        { "define",      circuit_define },
+        { "instance",    circuit_instance },
+        { "probe",       circuit_probe },
+        { "subcircuits", circuit_subcircuits },
+        { "stats",       circuit_stats },
+        { "metrics",     circuit_metrics },
+        { "save",        circuit_save },
+        { "open",        circuit_open },
+        { "begin",       circuit_begin },
+        { "commit",      circuit_commit },
+        { "undo",        circuit_undo },
+        { "redo",        circuit_redo },
+        { "history",     circuit_history },
+    });
+    batch_lua_install(L);
+    luaw_setglobal(L, "circuit", simulation);
+}
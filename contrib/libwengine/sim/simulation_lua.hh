@@ -0,0 +1,45 @@
+#ifndef SIMULATION_LUA_HH
+#define SIMULATION_LUA_HH
+
+#include <lua.hpp>
+
+class Simulation;
+
+// Creates the global `circuit`, through which scripts describe and drive the native simulation:
+//
+//   circuit:wire([n])                          -> id of a new wire (the first one, if n > 1)
+//   circuit:gate(type, {inputs}, [out], [delay]) -> output wire (created if not given)
+//   circuit:delay(wire, ticks)                 -- propagation delay of the gate driving `wire`
+//   circuit:retype(wire, type)                 -- change the type of the gate driving `wire`
+//   circuit:remove(wire)                       -- remove the gate driving `wire` (which becomes an input)
+//   circuit:set(wire, bool), circuit:get(wire)
+//   circuit:mode([name])                       -> current mode ("sweep", "event", "compiled" or "parallel"), optionally changing it
+//   circuit:step([n])
+//   circuit:compile()                          -- compile for the compiled mode now (raises on combinational loops)
+//   circuit:program()                          -> { instructions=, registers=, levels=, rebuilds=, appends= }
+//   circuit:batch(lanes)                       -> bit-parallel simulation of the compiled program (see batch_sim_lua.hh)
+//   circuit:threads([n])                       -> worker threads of the parallel mode, optionally changing it (0 = one per core)
+//   circuit:partitions([reset])                -> { steps=, steals=, cut=, imbalance=, threads=,
+//                                                   { gates=, weight=, boundary=, busy_ns=, load= }... }
+//   circuit:define(name, n_inputs, fn)        -> subcircuit id; fn(body, inputs...) builds the body with
+//                                                body:wire() / body:gate() and returns its output wires;
+//                                                body:instance(def, {inputs}) -> output wires, copies in the
+//                                                body of an existing definition (see Subcircuits::flatten)
+//   circuit:instance(def, {inputs}, [{outputs}]) -> instance id, output wires (created if not given)
+//   circuit:probe(instance, body_wire)         -> value of a wire inside an instance
+//   circuit:subcircuits()                      -> { instances=, memory=, { name=, inputs=, outputs=, wires=,
+//                                                   instructions=, registers=, instances=, loaded= }... }
+//   circuit:stats()                            -> { wires=, gates=, pins=, tick= }
+//   circuit:metrics([reset])                   -> event counters and queue depth of the event-driven mode
+//   circuit:save(path)                         -- write the circuit as a binary design file (see design_file.hh)
+//   circuit:open(path)                         -- map a design file as the circuit (which must still be empty)
+//
+// Edits through wire, gate, delay, retype and remove can be undone (see edit_history.hh):
+//
+//   circuit:begin(), circuit:commit()          -- group the edits in between into one undo step (they nest)
+//   circuit:undo(), circuit:redo()             -> false if there was nothing to undo/redo
+//   circuit:history([depth])                   -> { undo=, redo=, edits=, bytes=, depth= }, optionally changing
+//                                                 how many undo steps are kept
+void simulation_lua_install(lua_State* L, Simulation* simulation);
+
+#endif //SIMULATION_LUA_HH
@@ -0,0 +1,65 @@
+#ifndef SPSC_RING_HH
+#define SPSC_RING_HH
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+//
+// Lock-free ring buffer for exactly one producer thread and one consumer thread. The capacity is rounded up
+// to a power of two; head and tail live on separate cache lines so the two threads don't share one.
+//
+
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity)
+            n <<= 1;
+        mask_ = n - 1;
+        data_ = std::make_unique<T[]>(n);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    size_t size() const     { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+    // producer
+    bool push(T const& t) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_)
+                return false;
+        }
+        data_[tail & mask_] = t;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: calls f(T const&) for every available item, returns how many
+    template <typename F>
+    size_t drain(F f) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for (size_t i = head; i != tail; ++i)
+            f(data_[i & mask_]);
+        head_.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+private:
+    static constexpr size_t LINE = 64;
+
+    std::unique_ptr<T[]> data_;
+    size_t               mask_;
+
+    alignas(LINE) std::atomic<size_t> head_ = 0;   // written by the consumer
+    alignas(LINE) std::atomic<size_t> tail_ = 0;   // written by the producer
+    size_t                            head_cache_ = 0;
+};
+
+#endif //SPSC_RING_HH
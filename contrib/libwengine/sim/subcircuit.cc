@@ -0,0 +1,280 @@
+#include "subcircuit.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+//
+// DEFINITIONS
+//
+
+SubcircuitId Subcircuits::define(std::string const& name, Netlist body, std::vector<WireId> inputs, std::vector<WireId> outputs)
+{
+    Definition d;
+    d.name = name;
+    d.n_inputs = inputs.size();
+    d.n_outputs = outputs.size();
+    d.body = { std::move(body), std::move(inputs), std::move(outputs) };
+    load(d);
+
+    defs_.push_back(std::move(d));
+    return (SubcircuitId) (defs_.size() - 1);
+}
+
+SubcircuitId Subcircuits::define_lazy(std::string const& name, size_t n_inputs, size_t n_outputs, BodyLoader loader)
+{
+    Definition d;
+    d.name = name;
+    d.n_inputs = n_inputs;
+    d.n_outputs = n_outputs;
+    d.loader = std::move(loader);
+
+    defs_.push_back(std::move(d));
+    return (SubcircuitId) (defs_.size() - 1);
+}
+
+// checks and compiles the body (fetching it first, for lazy definitions), then sizes the state for the
+// instances created so far
+void Subcircuits::load(Definition& d)
+{
+    if (d.loaded)
+        return;
+    if (d.loader) {
+        d.body = d.loader();
+        if (d.body.inputs.size() != d.n_inputs || d.body.outputs.size() != d.n_outputs)
+            throw std::runtime_error("Subcircuit '" + d.name + "' doesn't have the ports it was declared with");
+    }
+
+    Netlist const& body = d.body.netlist;
+    for (WireId w : d.body.inputs) {
+        if (w >= body.wire_count())
+            throw std::out_of_range("Invalid wire " + std::to_string(w) + " in subcircuit '" + d.name + "'");
+        if (body.wire_driver(w) != NO_GATE)
+            throw std::invalid_argument("Input wire " + std::to_string(w) + " of subcircuit '" + d.name + "' is driven by a gate");
+    }
+    for (WireId w : d.body.outputs)
+        if (w >= body.wire_count())
+            throw std::out_of_range("Invalid wire " + std::to_string(w) + " in subcircuit '" + d.name + "'");
+
+    CompiledSimulator compiled(d.body.netlist);
+    compiled.compile();
+    d.program.assign(compiled.program().begin(), compiled.program().end());
+    for (GateId g : compiled.registers())
+        d.registers.emplace_back(body.gate_inputs(g)[0], body.gate_output(g));
+    d.words.load(d.program, 0);
+
+    d.loaded = true;
+    d.loader = nullptr;
+    while (d.count > d.words.words() * 64)
+        grow(d);
+}
+
+Subcircuits::Definition const& Subcircuits::definition(SubcircuitId def) const
+{
+    if (def >= defs_.size())
+        throw std::out_of_range("Invalid subcircuit " + std::to_string(def));
+    return defs_[def];
+}
+
+Subcircuits::Info Subcircuits::info(SubcircuitId def) const
+{
+    Definition const& d = definition(def);
+    return { d.name, d.n_inputs, d.n_outputs, d.body.netlist.wire_count(), d.program.size(), d.registers.size(), d.count, d.loaded };
+}
+
+Subcircuits::Body const& Subcircuits::body(SubcircuitId def)
+{
+    definition(def);
+    load(defs_[def]);
+    return defs_[def].body;
+}
+
+std::vector<WireId> Subcircuits::flatten(SubcircuitId def, Netlist& netlist, std::span<WireId const> inputs)
+{
+    Body const& b = body(def);
+    if (inputs.size() != b.inputs.size())
+        throw std::invalid_argument("Subcircuit '" + defs_[def].name + "' has " + std::to_string(b.inputs.size()) + " inputs");
+    for (WireId w : inputs)
+        if (w >= netlist.wire_count())
+            throw std::out_of_range("Invalid wire " + std::to_string(w));
+
+    // the body's inputs become `inputs`, and every other wire a new one (with its value, e.g. of a register)
+    Netlist const& from = b.netlist;
+    std::vector<WireId> map(from.wire_count(), NO_WIRE);
+    for (size_t i = 0; i < inputs.size(); ++i)
+        map[b.inputs[i]] = inputs[i];
+    size_t n_new = (size_t) std::count(map.begin(), map.end(), NO_WIRE);
+    WireId next = n_new ? netlist.add_wires(n_new) : 0;
+    for (WireId w = 0; w < from.wire_count(); ++w) {
+        if (map[w] != NO_WIRE)
+            continue;
+        map[w] = next++;
+        if (from.value(w))
+            netlist.set_value(map[w], true);
+    }
+
+    std::vector<WireId> pins;
+    for (GateId g = 0; g < from.gate_count(); ++g) {
+        if (from.gate_type(g) == GateType::None)
+            continue;
+        pins.clear();
+        for (WireId w : from.gate_inputs(g))
+            pins.push_back(map[w]);
+        netlist.add_gate(from.gate_type(g), pins, map[from.gate_output(g)], from.gate_delay(g));
+    }
+
+    std::vector<WireId> outputs;
+    for (WireId w : b.outputs)
+        outputs.push_back(map[w]);
+    return outputs;
+}
+
+//
+// INSTANCES
+//
+
+InstanceId Subcircuits::instantiate(SubcircuitId def, std::span<WireId const> inputs, std::span<WireId const> outputs)
+{
+    definition(def);
+    Definition& d = defs_[def];
+
+    if (inputs.size() != d.n_inputs || outputs.size() != d.n_outputs)
+        throw std::invalid_argument("Subcircuit '" + d.name + "' has " + std::to_string(d.n_inputs) + " inputs and "
+                                    + std::to_string(d.n_outputs) + " outputs");
+
+    driven_.resize(netlist_.wire_count(), 0);
+    auto check = [this](WireId w) {
+        if (w >= netlist_.wire_count())
+            throw std::out_of_range("Invalid wire " + std::to_string(w));
+    };
+    for (WireId w : inputs)
+        check(w);
+    for (WireId w : outputs) {
+        check(w);
+        if (netlist_.wire_driver(w) != NO_GATE || driven_[w])
+            throw std::invalid_argument("Wire " + std::to_string(w) + " is already driven");
+    }
+    for (WireId w : outputs)
+        driven_[w] = 1;
+    for (WireId w : inputs)
+        port_limit_ = std::max(port_limit_, w + 1);
+    for (WireId w : outputs)
+        port_limit_ = std::max(port_limit_, w + 1);
+
+    if (d.loaded && d.count == d.words.words() * 64)
+        grow(d);
+
+    d.ports.insert(d.ports.end(), inputs.begin(), inputs.end());
+    d.ports.insert(d.ports.end(), outputs.begin(), outputs.end());
+    d.settled = false;
+
+    instances_.push_back({ def, (uint32_t) d.count++ });
+    return (InstanceId) (instances_.size() - 1);
+}
+
+// doubles the number of lanes, keeping the state of the existing instances
+void Subcircuits::grow(Definition& d)
+{
+    size_t old_words = d.words.words();
+    size_t new_words = std::max<size_t>(1, old_words * 2);
+    size_t n_wires = d.body.netlist.wire_count();
+
+    std::vector<uint64_t> state(n_wires * new_words, 0);
+    for (size_t w = 0; w < n_wires; ++w)
+        std::copy_n(d.state.begin() + (ptrdiff_t) (w * old_words), old_words, state.begin() + (ptrdiff_t) (w * new_words));
+
+    d.state = std::move(state);
+    d.words.load(d.program, new_words);
+}
+
+Subcircuits::InstanceRef Subcircuits::instance(InstanceId inst) const
+{
+    if (inst >= instances_.size())
+        throw std::out_of_range("Invalid instance " + std::to_string(inst));
+    return instances_[inst];
+}
+
+SubcircuitId Subcircuits::instance_definition(InstanceId inst) const
+{
+    return instance(inst).def;
+}
+
+std::span<WireId const> Subcircuits::instance_ports(InstanceId inst) const
+{
+    InstanceRef ref = instance(inst);
+    Definition const& d = defs_[ref.def];
+    size_t n_ports = d.n_inputs + d.n_outputs;
+    return { d.ports.data() + ref.index * n_ports, n_ports };
+}
+
+bool Subcircuits::probe(InstanceId inst, WireId body_wire)
+{
+    InstanceRef ref = instance(inst);
+    Definition& d = defs_[ref.def];
+    load(d);
+    if (body_wire >= d.body.netlist.wire_count())
+        throw std::out_of_range("Invalid wire " + std::to_string(body_wire) + " in subcircuit '" + d.name + "'");
+    return (d.state[body_wire * d.words.words() + ref.index / 64] >> (ref.index % 64)) & 1;
+}
+
+size_t Subcircuits::memory() const
+{
+    size_t bytes = instances_.capacity() * sizeof(InstanceRef) + driven_.capacity();
+    for (Definition const& d : defs_)
+        bytes += (d.state.capacity() + d.latched.capacity()) * sizeof(uint64_t) + d.ports.capacity() * sizeof(WireId);
+    return bytes;
+}
+
+//
+// EVALUATION
+//
+
+void Subcircuits::step(std::vector<WireId>& changed)
+{
+    for (Definition& d : defs_) {
+        if (d.count > 0) {
+            load(d);
+            evaluate(d, changed);
+        }
+    }
+}
+
+void Subcircuits::evaluate(Definition& d, std::vector<WireId>& changed)
+{
+    size_t words = d.words.words();
+    std::vector<WireId> const& inputs = d.body.inputs;
+    std::vector<WireId> const& outputs = d.body.outputs;
+    size_t n_ports = inputs.size() + outputs.size();
+    uint64_t* state = d.state.data();
+
+    // gather the inputs
+    for (size_t p = 0; p < inputs.size(); ++p) {
+        uint64_t* v = state + inputs[p] * words;
+        std::fill_n(v, words, 0);
+        for (size_t k = 0; k < d.count; ++k)
+            v[k / 64] |= uint64_t(netlist_.value(d.ports[k * n_ports + p])) << (k % 64);
+    }
+
+    if (!d.settled) {
+        d.words.run(state);   // settle before the first clock edge
+        d.settled = true;
+    }
+
+    // clock edge
+    d.latched.resize(d.registers.size() * words);
+    for (size_t r = 0; r < d.registers.size(); ++r)
+        std::copy_n(state + d.registers[r].first * words, words, d.latched.begin() + (ptrdiff_t) (r * words));
+    for (size_t r = 0; r < d.registers.size(); ++r)
+        std::copy_n(d.latched.begin() + (ptrdiff_t) (r * words), words, state + d.registers[r].second * words);
+
+    d.words.run(state);
+
+    // scatter the outputs
+    for (size_t p = 0; p < outputs.size(); ++p) {
+        uint64_t const* v = state + outputs[p] * words;
+        for (size_t k = 0; k < d.count; ++k) {
+            WireId w = d.ports[k * n_ports + inputs.size() + p];
+            if (netlist_.set_value(w, (v[k / 64] >> (k % 64)) & 1))
+                changed.push_back(w);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef SUBCIRCUIT_HH
+#define SUBCIRCUIT_HH
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "netlist.hh"
+#include "compiled_sim.hh"
+#include "word_program.hh"
+
+using SubcircuitId = uint32_t;
+using InstanceId = uint32_t;
+
+//
+// Subcircuits defined once and instantiated many times in the main netlist. A definition owns its netlist
+// and compiled program; an instance is only a list of the main netlist wires connected to its ports, and
+// one bit per internal wire. The instances of a definition are evaluated together: bit k of every internal
+// wire belongs to instance k, so the compiled program runs once for 64 instances per word (see WordProgram).
+//
+// On every simulation step, each instance reads its input wires, latches its registers and settles (like
+// one cycle of the compiled mode), then writes its output wires. So a signal crossing an instance takes one
+// step, whatever the simulation mode. Instance outputs must not be driven by anything else.
+//
+// A definition may also be given only by its name and port counts, with a function that provides its body
+// when it's first needed (stepping an instance, probing one, or reading the body); only then is the body
+// checked and compiled.
+//
+// Definitions nest by flattening: a body being built can copy in the body of an existing definition
+// (`flatten`), so a definition may be made of others while its instances stay one level deep.
+//
+
+class Subcircuits {
+public:
+    struct Body {
+        Netlist             netlist;
+        std::vector<WireId> inputs;
+        std::vector<WireId> outputs;
+    };
+    using BodyLoader = std::function<Body()>;
+
+    struct Info {
+        std::string name;
+        size_t      inputs;
+        size_t      outputs;
+        size_t      wires;          // wires, instructions and registers are 0 until the body is loaded
+        size_t      instructions;
+        size_t      registers;
+        size_t      instances;
+        bool        loaded;
+    };
+
+    explicit Subcircuits(Netlist& netlist) : netlist_(netlist) {}
+
+    // `inputs` must be wires of `body` not driven by any gate (throws CombinationalLoopError for loops in the body)
+    SubcircuitId define(std::string const& name, Netlist body, std::vector<WireId> inputs, std::vector<WireId> outputs);
+    SubcircuitId define_lazy(std::string const& name, size_t n_inputs, size_t n_outputs, BodyLoader loader);
+    InstanceId   instantiate(SubcircuitId def, std::span<WireId const> inputs, std::span<WireId const> outputs);
+
+    // copies the gates of the body of `def` into `netlist` (a body being built), reading `inputs`, and returns
+    // the wires of its outputs
+    std::vector<WireId> flatten(SubcircuitId def, Netlist& netlist, std::span<WireId const> inputs);
+
+    void step(std::vector<WireId>& changed);          // appends the main netlist wires that changed
+    bool probe(InstanceId inst, WireId body_wire);
+
+    size_t      definition_count() const { return defs_.size(); }
+    size_t      instance_count() const   { return instances_.size(); }
+    Info        info(SubcircuitId def) const;
+    size_t      memory() const;                       // bytes used by the instances
+    Body const& body(SubcircuitId def);               // loads it if needed
+
+    SubcircuitId            instance_definition(InstanceId inst) const;
+    std::span<WireId const> instance_ports(InstanceId inst) const;   // inputs, then outputs
+    bool                    drives(WireId w) const { return w < driven_.size() && driven_[w]; }
+    WireId                  port_limit() const { return port_limit_; }   // every instance port is a wire below this
+
+private:
+    struct Definition {
+        std::string                                 name;
+        size_t                                      n_inputs = 0;
+        size_t                                      n_outputs = 0;
+        BodyLoader                                  loader;      // until loaded
+        bool                                        loaded = false;
+        Body                                        body;
+        std::vector<CompiledSimulator::Instruction> program;
+        std::vector<std::pair<WireId, WireId>>      registers;   // (d, q)
+        WordProgram                                 words;
+        size_t                                      count = 0;   // instances
+        std::vector<uint64_t>                       state;       // wire-major, words.words() per wire
+        std::vector<WireId>                         ports;       // instance-major: inputs, then outputs
+        std::vector<uint64_t>                       latched;
+        bool                                        settled = false;
+    };
+
+    struct InstanceRef {
+        SubcircuitId def;
+        uint32_t     index;
+    };
+
+    Definition const& definition(SubcircuitId def) const;
+    InstanceRef       instance(InstanceId inst) const;
+    void              load(Definition& d);
+    void              grow(Definition& d);
+    void              evaluate(Definition& d, std::vector<WireId>& changed);
+
+    Netlist&                 netlist_;
+    std::vector<Definition>  defs_;
+    std::vector<InstanceRef> instances_;
+    std::vector<uint8_t>     driven_;   // main netlist wires driven by an instance output
+    WireId                   port_limit_ = 0;
+};
+
+#endif //SUBCIRCUIT_HH
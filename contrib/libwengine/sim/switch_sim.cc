@@ -0,0 +1,318 @@
+#include "switch_sim.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static uint8_t bit(SwitchValue v)
+{
+    return (uint8_t) (1 << (int) v);
+}
+
+static SwitchValue from_bits(uint8_t values)
+{
+    if (values == bit(SwitchValue::Lo))
+        return SwitchValue::Lo;
+    if (values == bit(SwitchValue::Hi))
+        return SwitchValue::Hi;
+    return SwitchValue::X;
+}
+
+SwitchNetwork::Conduction SwitchNetwork::conduction(TransistorType type, SwitchValue gate)
+{
+    if (gate == SwitchValue::X)
+        return Conduction::Unknown;
+    bool on = (gate == SwitchValue::Hi) == (type == TransistorType::NMOS);
+    return on ? Conduction::On : Conduction::Off;
+}
+
+SwitchNetwork::SwitchNetwork()
+{
+    add_input(SwitchValue::Lo);   // GND
+    add_input(SwitchValue::Hi);   // VDD
+}
+
+//
+// STRUCTURE
+//
+
+NodeId SwitchNetwork::add_node(uint8_t capacitance)
+{
+    if (capacitance == 0)
+        throw std::invalid_argument("Node capacitance must be at least 1");
+
+    NodeId n = (NodeId) value_.size();
+    value_.push_back(SwitchValue::X);
+    capacitance_.push_back(capacitance);
+    input_strength_.push_back(0);
+    parent_.push_back(n);
+    is_dirty_.push_back(0);
+    touched_mark_.push_back(0);
+    slot_.push_back(0);
+    terminals_valid_ = false;
+    return n;
+}
+
+NodeId SwitchNetwork::add_input(SwitchValue v, uint8_t strength)
+{
+    if (strength == 0)
+        throw std::invalid_argument("Input strength must be at least 1");
+
+    NodeId n = add_node();
+    value_[n] = v;
+    input_strength_[n] = strength;
+    return n;
+}
+
+TransistorId SwitchNetwork::add_transistor(TransistorType type, NodeId gate, NodeId source, NodeId drain, uint8_t strength)
+{
+    check_node(gate);
+    check_node(source);
+    check_node(drain);
+    if (source == drain)
+        throw std::invalid_argument("Transistor source and drain must be different nodes");
+    if (strength == 0)
+        throw std::invalid_argument("Transistor strength must be at least 1");
+
+    TransistorId t = (TransistorId) type_.size();
+    type_.push_back(type);
+    gate_.push_back(gate);
+    source_.push_back(source);
+    drain_.push_back(drain);
+    strength_.push_back(strength);
+    conduction_.push_back(conduction(type, value_[gate]));
+    terminals_valid_ = false;
+
+    mark_dirty(source);
+    mark_dirty(drain);
+    stats_.pending = dirty_.size();
+    return t;
+}
+
+void SwitchNetwork::check_node(NodeId n) const
+{
+    if (n >= value_.size())
+        throw std::out_of_range("Invalid node " + std::to_string(n));
+}
+
+// counting sort of the transistor terminals by node
+void SwitchNetwork::build_terminals() const
+{
+    if (terminals_valid_)
+        return;
+
+    auto build = [this](std::vector<uint32_t>& offset, std::vector<TransistorId>& list, auto for_each_terminal) {
+        offset.assign(value_.size() + 1, 0);
+        for_each_terminal([&](TransistorId, NodeId n) { ++offset[n + 1]; });
+        for (size_t i = 1; i < offset.size(); ++i)
+            offset[i] += offset[i - 1];
+        list.resize(offset.back());
+        std::vector<uint32_t> pos(offset.begin(), offset.end() - 1);
+        for_each_terminal([&](TransistorId t, NodeId n) { list[pos[n]++] = t; });
+    };
+
+    build(channel_offset_, channel_, [this](auto f) {
+        for (TransistorId t = 0; t < type_.size(); ++t) {
+            f(t, source_[t]);
+            f(t, drain_[t]);
+        }
+    });
+    build(gated_offset_, gated_, [this](auto f) {
+        for (TransistorId t = 0; t < type_.size(); ++t)
+            f(t, gate_[t]);
+    });
+
+    terminals_valid_ = true;
+}
+
+//
+// VALUES
+//
+
+void SwitchNetwork::set_input(NodeId n, SwitchValue v)
+{
+    check_node(n);
+    if (!is_input(n))
+        throw std::invalid_argument("Node " + std::to_string(n) + " is not an input");
+    if (value_[n] == v)
+        return;
+
+    build_terminals();
+    value_[n] = v;
+    gate_changed(n);
+    for (TransistorId t : channel(n))
+        if (conduction_[t] != Conduction::Off)
+            mark_dirty(other(t, n));
+    stats_.pending = dirty_.size();
+}
+
+NodeId SwitchNetwork::region(NodeId n)
+{
+    check_node(n);
+    return find(n);
+}
+
+void SwitchNetwork::mark_dirty(NodeId n)
+{
+    if (is_input(n) || is_dirty_[n])
+        return;
+    is_dirty_[n] = 1;
+    dirty_.push_back(n);
+}
+
+void SwitchNetwork::gate_changed(NodeId n)
+{
+    for (TransistorId t : gated(n)) {
+        Conduction c = conduction(type_[t], value_[n]);
+        if (c != conduction_[t]) {
+            conduction_[t] = c;
+            ++stats_.transistor_switches;
+            mark_dirty(source_[t]);
+            mark_dirty(drain_[t]);
+        }
+    }
+}
+
+NodeId SwitchNetwork::find(NodeId n)
+{
+    while (parent_[n] != n) {
+        parent_[n] = parent_[parent_[n]];   // path halving
+        n = parent_[n];
+    }
+    return n;
+}
+
+//
+// RESOLUTION
+//
+
+// Everything reachable through transistors that are not off. A region changes only if a transistor inside it
+// or around it switched, and both of its terminals are marked dirty, so the touched set always holds whole
+// regions, old and new.
+void SwitchNetwork::collect(NodeId start)
+{
+    size_t first = touched_.size();
+    touched_mark_[start] = mark_;
+    touched_.push_back(start);
+
+    for (size_t i = first; i < touched_.size(); ++i) {
+        NodeId n = touched_[i];
+        for (TransistorId t : channel(n)) {
+            NodeId o = other(t, n);
+            if (conduction_[t] != Conduction::Off && !is_input(o) && touched_mark_[o] != mark_) {
+                touched_mark_[o] = mark_;
+                touched_.push_back(o);
+            }
+        }
+    }
+}
+
+bool SwitchNetwork::step()
+{
+    if (dirty_.empty())
+        return false;
+
+    build_terminals();
+    ++stats_.steps;
+
+    std::swap(seeds_, dirty_);
+    dirty_.clear();
+    for (NodeId n : seeds_)
+        is_dirty_[n] = 0;
+
+    if (++mark_ == 0) {
+        std::fill(touched_mark_.begin(), touched_mark_.end(), 0);
+        mark_ = 1;
+    }
+    touched_.clear();
+    for (NodeId n : seeds_)
+        if (touched_mark_[n] != mark_)
+            collect(n);
+
+    // rebuild the union-find for the touched nodes only
+    for (NodeId n : touched_)
+        parent_[n] = n;
+    for (NodeId n : touched_) {
+        for (TransistorId t : channel(n)) {
+            NodeId o = other(t, n);
+            if (conduction_[t] == Conduction::On && !is_input(o)) {
+                NodeId a = find(n), b = find(o);
+                if (a != b)
+                    parent_[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+
+    resolution_.clear();
+    for (NodeId n : touched_) {
+        if (find(n) == n) {
+            slot_[n] = (uint32_t) resolution_.size();
+            resolution_.emplace_back();
+        }
+    }
+
+    // drivers and stored charge
+    for (NodeId n : touched_) {
+        Resolution& r = resolution(n);
+        if (capacitance_[n] > r.charge) {
+            r.charge = capacitance_[n];
+            r.charge_values = bit(value_[n]);
+        } else if (capacitance_[n] == r.charge) {
+            r.charge_values |= bit(value_[n]);
+        }
+
+        for (TransistorId t : channel(n)) {
+            NodeId o = other(t, n);
+            if (conduction_[t] != Conduction::On || !is_input(o))
+                continue;
+            uint8_t s = std::min(input_strength_[o], strength_[t]);
+            if (s > r.drive) {
+                r.drive = s;
+                r.drive_values = bit(value_[o]);
+            } else if (s == r.drive) {
+                r.drive_values |= bit(value_[o]);
+            }
+        }
+    }
+    for (Resolution& r : resolution_)
+        r.value = r.final = from_bits(r.drive ? r.drive_values : r.charge_values);
+
+    // transistors with an X gate: both sides become X if they disagree
+    for (NodeId n : touched_) {
+        for (TransistorId t : channel(n)) {
+            if (conduction_[t] != Conduction::Unknown)
+                continue;
+            NodeId o = other(t, n);
+            Resolution& r = resolution(n);
+            SwitchValue vo = is_input(o) ? value_[o] : resolution(o).value;
+            if (r.value != vo) {
+                r.final = SwitchValue::X;
+                if (!is_input(o))
+                    resolution(o).final = SwitchValue::X;
+            }
+        }
+    }
+
+    stats_.regions_resolved += resolution_.size();
+    stats_.nodes_resolved += touched_.size();
+
+    for (NodeId n : touched_) {
+        SwitchValue v = resolution(n).final;
+        if (v != value_[n]) {
+            value_[n] = v;
+            ++stats_.node_changes;
+            gate_changed(n);
+        }
+    }
+
+    stats_.pending = dirty_.size();
+    return true;
+}
+
+size_t SwitchNetwork::settle(size_t max_steps)
+{
+    size_t n = 0;
+    while (n < max_steps && step())
+        ++n;
+    return n;
+}
@@ -0,0 +1,131 @@
+#ifndef SWITCH_SIM_HH
+#define SWITCH_SIM_HH
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using NodeId = uint32_t;
+using TransistorId = uint32_t;
+
+enum class SwitchValue : uint8_t { Lo, Hi, X };
+enum class TransistorType : uint8_t { NMOS, PMOS };
+
+//
+// Switch-level simulation: transistors are bidirectional switches between two nodes, conducting when their
+// gate is Hi (NMOS) or Lo (PMOS). Nodes connected by conducting transistors form a region, which takes the
+// value of its strongest drivers (an input node seen through a transistor drives with the weaker of the
+// two strengths, and equal drivers that disagree give X). A region with no drivers keeps its stored charge:
+// the largest capacitance wins, equal capacitances that disagree give X.
+//
+// Input nodes (supplies and circuit inputs) are never part of a region, they only drive them. Regions are
+// kept in a union-find structure that is rebuilt incrementally: only the regions around a transistor that
+// switched, or an input that changed, are collected again and re-resolved.
+//
+// Each step is one unit of delay: the dirty regions are resolved with the transistor states of the start
+// of the step, and transistors whose gate changed take their new state for the next one. A transistor with
+// an X gate is treated as open, except that the nodes on both sides become X if they disagree.
+//
+
+class SwitchNetwork {
+public:
+    static constexpr NodeId  GND = 0;
+    static constexpr NodeId  VDD = 1;
+
+    static constexpr uint8_t SUPPLY = 255;   // input strength
+    static constexpr uint8_t NORMAL = 4;     // transistor strengths
+    static constexpr uint8_t WEAK = 2;
+
+    struct Stats {
+        uint64_t steps = 0;
+        uint64_t regions_resolved = 0;
+        uint64_t nodes_resolved = 0;
+        uint64_t node_changes = 0;
+        uint64_t transistor_switches = 0;
+        size_t   pending = 0;              // dirty nodes for the next step
+    };
+
+    SwitchNetwork();   // creates GND and VDD
+
+    // structure
+
+    NodeId       add_node(uint8_t capacitance = 1);
+    NodeId       add_input(SwitchValue v, uint8_t strength = SUPPLY);
+    TransistorId add_transistor(TransistorType type, NodeId gate, NodeId source, NodeId drain, uint8_t strength = NORMAL);
+
+    size_t node_count() const { return value_.size(); }
+    size_t transistor_count() const { return type_.size(); }
+    bool   is_input(NodeId n) const { return input_strength_[n] != 0; }
+
+    // values
+
+    void        set_input(NodeId n, SwitchValue v);
+    SwitchValue value(NodeId n) const { return value_[n]; }
+    NodeId      region(NodeId n);     // representative node of the region `n` belongs to
+
+    bool   step();                        // returns false if nothing was pending
+    size_t settle(size_t max_steps);      // steps until nothing is pending; returns the number of steps
+
+    Stats const& stats() const { return stats_; }
+
+private:
+    enum class Conduction : uint8_t { Off, On, Unknown };
+
+    struct Resolution {
+        uint8_t     drive = 0;          // strongest drive seen
+        uint8_t     drive_values = 0;   // bit per SwitchValue, at that strength
+        uint8_t     charge = 0;         // largest capacitance seen
+        uint8_t     charge_values = 0;
+        SwitchValue value = SwitchValue::X;
+        SwitchValue final = SwitchValue::X;   // after the X gates are taken into account
+    };
+
+    void        check_node(NodeId n) const;
+    void        build_terminals() const;
+    void        mark_dirty(NodeId n);
+    void        gate_changed(NodeId n);
+    void        collect(NodeId start);
+    NodeId      find(NodeId n);
+    Resolution& resolution(NodeId n) { return resolution_[slot_[find(n)]]; }
+
+    std::span<TransistorId const> channel(NodeId n) const { return { channel_.data() + channel_offset_[n], channel_offset_[n + 1] - channel_offset_[n] }; }
+    std::span<TransistorId const> gated(NodeId n) const   { return { gated_.data() + gated_offset_[n], gated_offset_[n + 1] - gated_offset_[n] }; }
+    NodeId                        other(TransistorId t, NodeId n) const { return source_[t] == n ? drain_[t] : source_[t]; }
+
+    static Conduction conduction(TransistorType type, SwitchValue gate);
+
+    // nodes
+    std::vector<SwitchValue> value_;
+    std::vector<uint8_t>     capacitance_;
+    std::vector<uint8_t>     input_strength_;   // 0 for regular nodes
+    std::vector<NodeId>      parent_;           // union-find
+
+    // transistors
+    std::vector<TransistorType> type_;
+    std::vector<NodeId>         gate_;
+    std::vector<NodeId>         source_;
+    std::vector<NodeId>         drain_;
+    std::vector<uint8_t>        strength_;
+    std::vector<Conduction>     conduction_;
+
+    // node -> transistors (CSR, rebuilt lazily after structural changes)
+    mutable std::vector<uint32_t>     channel_offset_;   // transistors with the node as source or drain
+    mutable std::vector<TransistorId> channel_;
+    mutable std::vector<uint32_t>     gated_offset_;     // transistors with the node as gate
+    mutable std::vector<TransistorId> gated_;
+    mutable bool                      terminals_valid_ = false;
+
+    // work lists
+    std::vector<NodeId>      dirty_;
+    std::vector<NodeId>      seeds_;          // the dirty nodes being processed
+    std::vector<uint8_t>     is_dirty_;
+    std::vector<NodeId>      touched_;        // nodes being re-resolved in this step
+    std::vector<uint32_t>    touched_mark_;   // == mark_ when in touched_
+    uint32_t                 mark_ = 0;
+    std::vector<uint32_t>    slot_;           // per region root: index into resolution_
+    std::vector<Resolution>  resolution_;
+
+    Stats stats_;
+};
+
+#endif //SWITCH_SIM_HH
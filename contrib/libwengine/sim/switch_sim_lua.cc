@@ -0,0 +1,143 @@
+#include "switch_sim_lua.hh"
+
+#include "luaw/luaw.hh"
+#include "switch_sim.hh"
+
+static SwitchNetwork* self(lua_State* L)
+{
+    SwitchNetwork* net = nullptr;
+    luaw_protect(L, [&] { net = luaw_to<SwitchNetwork*>(L, 1); return 0; });
+    return net;
+}
+
+static NodeId check_node(lua_State* L, SwitchNetwork* net, int index)
+{
+    lua_Integer n = luaL_checkinteger(L, index);
+    luaL_argcheck(L, n >= 0 && (size_t) n < net->node_count(), index, "invalid node");
+    return (NodeId) n;
+}
+
+// strengths and capacitances
+static uint8_t check_level(lua_State* L, int index, uint8_t def)
+{
+    lua_Integer s = luaL_optinteger(L, index, def);
+    luaL_argcheck(L, s >= 1 && s <= 255, index, "must be between 1 and 255");
+    return (uint8_t) s;
+}
+
+static SwitchValue to_value(lua_State* L, int index)
+{
+    if (lua_isnoneornil(L, index))
+        return SwitchValue::X;
+    return lua_toboolean(L, index) ? SwitchValue::Hi : SwitchValue::Lo;
+}
+
+static int push_value(lua_State* L, SwitchValue v)
+{
+    if (v == SwitchValue::X)
+        lua_pushnil(L);
+    else
+        lua_pushboolean(L, v == SwitchValue::Hi);
+    return 1;
+}
+
+static int transistors_gnd(lua_State* L) { return luaw_push(L, SwitchNetwork::GND); }
+static int transistors_vdd(lua_State* L) { return luaw_push(L, SwitchNetwork::VDD); }
+
+static int transistors_node(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        return luaw_push(L, self(L)->add_node(check_level(L, 2, 1)));
+    });
+}
+
+static int transistors_input(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        return luaw_push(L, self(L)->add_input(to_value(L, 2), check_level(L, 3, SwitchNetwork::SUPPLY)));
+    });
+}
+
+static int add_transistor(lua_State* L, TransistorType type)
+{
+    return luaw_protect(L, [&] {
+        SwitchNetwork* net = self(L);
+        NodeId gate = check_node(L, net, 2), a = check_node(L, net, 3), b = check_node(L, net, 4);
+        return luaw_push(L, net->add_transistor(type, gate, a, b, check_level(L, 5, SwitchNetwork::NORMAL)));
+    });
+}
+
+static int transistors_nmos(lua_State* L) { return add_transistor(L, TransistorType::NMOS); }
+static int transistors_pmos(lua_State* L) { return add_transistor(L, TransistorType::PMOS); }
+
+static int transistors_set(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        SwitchNetwork* net = self(L);
+        net->set_input(check_node(L, net, 2), to_value(L, 3));
+        return 0;
+    });
+}
+
+static int transistors_get(lua_State* L)
+{
+    SwitchNetwork* net = self(L);
+    return push_value(L, net->value(check_node(L, net, 2)));
+}
+
+static int transistors_region(lua_State* L)
+{
+    SwitchNetwork* net = self(L);
+    return luaw_push(L, net->region(check_node(L, net, 2)));
+}
+
+static int transistors_step(lua_State* L)
+{
+    return luaw_push(L, self(L)->step());
+}
+
+static int transistors_settle(lua_State* L)
+{
+    SwitchNetwork* net = self(L);
+    lua_Integer max_steps = luaL_optinteger(L, 2, 10000);
+    luaL_argcheck(L, max_steps >= 0, 2, "negative number of steps");
+    size_t steps = net->settle((size_t) max_steps);
+    luaw_push(L, steps);
+    luaw_push(L, net->stats().pending == 0);
+    return 2;
+}
+
+static int transistors_stats(lua_State* L)
+{
+    SwitchNetwork* net = self(L);
+    auto const& st = net->stats();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "nodes", net->node_count());
+    luaw_setfield(L, -1, "transistors", net->transistor_count());
+    luaw_setfield(L, -1, "steps", st.steps);
+    luaw_setfield(L, -1, "regions_resolved", st.regions_resolved);
+    luaw_setfield(L, -1, "nodes_resolved", st.nodes_resolved);
+    luaw_setfield(L, -1, "node_changes", st.node_changes);
+    luaw_setfield(L, -1, "transistor_switches", st.transistor_switches);
+    luaw_setfield(L, -1, "pending", st.pending);
+    return 1;
+}
+
+void switch_sim_lua_install(lua_State* L, SwitchNetwork* network)
+{
+    luaw_set_metatable<SwitchNetwork>(L, {
+        { "gnd",    transistors_gnd },
+        { "vdd",    transistors_vdd },
+        { "node",   transistors_node },
+        { "input",  transistors_input },
+        { "nmos",   transistors_nmos },
+        { "pmos",   transistors_pmos },
+        { "set",    transistors_set },
+        { "get",    transistors_get },
+        { "region", transistors_region },
+        { "step",   transistors_step },
+        { "settle", transistors_settle },
+        { "stats",  transistors_stats },
+    });
+    luaw_setglobal(L, "transistors", network);
+}
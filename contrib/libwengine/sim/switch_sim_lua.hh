@@ -0,0 +1,22 @@
+#ifndef SWITCH_SIM_LUA_HH
+#define SWITCH_SIM_LUA_HH
+
+#include <lua.hpp>
+
+class SwitchNetwork;
+
+// Creates the global `transistors`, the switch-level network. Values are true (Hi), false (Lo) or nil (X).
+//
+//   transistors:gnd(), transistors:vdd()            -> supply nodes
+//   transistors:node([capacitance])                 -> new node (starts as X)
+//   transistors:input(value, [strength])            -> new input node
+//   transistors:nmos(gate, a, b, [strength])        -> transistor id; also transistors:pmos
+//   transistors:set(input, value), transistors:get(node)
+//   transistors:region(node)                        -> representative node of its conductive region
+//   transistors:step()                              -> false if nothing was pending
+//   transistors:settle([max_steps])                 -> steps taken, and whether the network is stable
+//   transistors:stats()                             -> { nodes=, transistors=, steps=, regions_resolved=, nodes_resolved=,
+//                                                        node_changes=, transistor_switches=, pending= }
+void switch_sim_lua_install(lua_State* L, SwitchNetwork* network);
+
+#endif //SWITCH_SIM_LUA_HH
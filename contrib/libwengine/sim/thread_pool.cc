@@ -0,0 +1,106 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(size_t n_workers)
+{
+    n_workers = std::max<size_t>(n_workers, 1);
+    for (size_t i = 0; i < n_workers; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    for (size_t i = 1; i < n_workers; ++i)
+        threads_.emplace_back([this, i] { worker(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+void WorkStealingPool::run(size_t n_tasks, Task const& task)
+{
+    size_t n = queues_.size();
+    for (size_t i = 0; i < n; ++i) {
+        Queue& queue = *queues_[i];
+        std::lock_guard lock(queue.mutex);
+        for (size_t t = i * n_tasks / n; t < (i + 1) * n_tasks / n; ++t)
+            queue.tasks.push_back(t);
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        task_ = &task;
+        running_ = threads_.size();
+        ++generation_;
+    }
+    start_.notify_all();
+
+    work(0);
+
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    task_ = nullptr;
+}
+
+void WorkStealingPool::worker(size_t id)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+
+        work(id);
+
+        {
+            std::lock_guard lock(mutex_);
+            if (--running_ == 0)
+                done_.notify_one();
+        }
+    }
+}
+
+// No tasks are queued while a run is in progress, so once every queue is empty the worker is done.
+void WorkStealingPool::work(size_t id)
+{
+    size_t task;
+    while (next_task(id, task))
+        (*task_)(task, id);
+}
+
+bool WorkStealingPool::next_task(size_t id, size_t& task)
+{
+    {
+        Queue& own = *queues_[id];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(id + i) % queues_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Fork-join pool with work stealing. `run` splits the task indices in contiguous blocks, one per worker
+// queue; a worker takes tasks from the front of its own queue and, once it is empty, steals from the back
+// of the others. `run` returns when every task is done, so each call is a barrier.
+//
+// The calling thread is worker 0, so a pool of size 1 starts no threads.
+//
+
+class WorkStealingPool {
+public:
+    using Task = std::function<void(size_t task, size_t worker)>;
+
+    explicit WorkStealingPool(size_t n_workers);
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+    ~WorkStealingPool();
+
+    void run(size_t n_tasks, Task const& task);
+
+    size_t   size() const { return queues_.size(); }
+    uint64_t steals() const { return steals_; }
+
+private:
+    struct Queue {
+        std::mutex         mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void worker(size_t id);
+    void work(size_t id);
+    bool next_task(size_t id, size_t& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread>            threads_;
+    Task const*                         task_ = nullptr;
+    std::atomic<uint64_t>               steals_ = 0;
+
+    std::mutex              mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    uint64_t                generation_ = 0;
+    size_t                  running_ = 0;
+    bool                    stop_ = false;
+};
+
+#endif //THREAD_POOL_HH
@@ -0,0 +1,84 @@
+#ifndef TIMING_WHEEL_HH
+#define TIMING_WHEEL_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Hierarchical timing wheel: LEVELS wheels of 2^BITS slots each. Level `l` holds the items whose time
+// shares all digits above `l` with the current time; when a lower wheel wraps around, the next slot of
+// the level above is cascaded down. Items beyond the horizon wait in an overflow list.
+//
+
+template <typename T, unsigned LEVELS = 4, unsigned BITS = 8>
+class TimingWheel {
+    static_assert(BITS * LEVELS < 64);
+public:
+    // `time` must be in the future (> now())
+    void schedule(uint64_t time, T const& item) { insert({ time, item }); ++size_; }
+
+    // advance the clock by one and append the items due at the new time to `due`
+    void advance(std::vector<T>& due) {
+        ++now_;
+
+        if ((now_ & ((uint64_t(1) << (BITS * LEVELS)) - 1)) == 0) {
+            std::vector<Entry> overflow;
+            overflow.swap(overflow_);
+            for (Entry const& e : overflow)
+                insert(e);
+        }
+        for (unsigned l = LEVELS - 1; l > 0; --l) {
+            if ((now_ & ((uint64_t(1) << (BITS * l)) - 1)) == 0)
+                cascade(l);
+        }
+
+        std::vector<Entry>& slot = slots_[0][now_ & MASK];
+        for (Entry const& e : slot)
+            due.push_back(e.item);
+        size_ -= slot.size();
+        slot.clear();
+    }
+
+    void clear() {
+        for (auto& level : slots_)
+            for (auto& slot : level)
+                slot.clear();
+        overflow_.clear();
+        size_ = 0;
+    }
+
+    uint64_t now() const  { return now_; }
+    size_t   size() const { return size_; }
+
+private:
+    static constexpr uint64_t SLOTS = uint64_t(1) << BITS;
+    static constexpr uint64_t MASK = SLOTS - 1;
+
+    struct Entry { uint64_t time; T item; };
+
+    void insert(Entry const& e) {
+        for (unsigned l = 0; l < LEVELS; ++l) {
+            if ((e.time >> (BITS * (l + 1))) == (now_ >> (BITS * (l + 1)))) {
+                slots_[l][(e.time >> (BITS * l)) & MASK].push_back(e);
+                return;
+            }
+        }
+        overflow_.push_back(e);
+    }
+
+    void cascade(unsigned level) {
+        std::vector<Entry> entries;
+        entries.swap(slots_[level][(now_ >> (BITS * level)) & MASK]);
+        for (Entry const& e : entries)
+            insert(e);
+    }
+
+    std::array<std::array<std::vector<Entry>, SLOTS>, LEVELS> slots_ {};
+    std::vector<Entry>                                        overflow_;
+    uint64_t                                                  now_ = 0;
+    size_t                                                    size_ = 0;
+};
+
+#endif //TIMING_WHEEL_HH
@@ -0,0 +1,37 @@
+#ifndef TRIPLE_BUFFER_HH
+#define TRIPLE_BUFFER_HH
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Lock-free exchange of the latest value between one writer thread and one reader thread. The writer fills
+// `back()` and publishes it; the reader gets the most recently published slot, and keeps its own slot
+// while it reads it. Neither side ever waits for the other: stale values are simply skipped.
+//
+
+template <typename T>
+class TripleBuffer {
+public:
+    // writer
+    T&   back() { return slots_[back_]; }
+    void publish() { back_ = state_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // reader
+    T const& read() {
+        if (state_.load(std::memory_order_relaxed) & FRESH)
+            front_ = state_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return slots_[front_];
+    }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T                    slots_[3];
+    uint8_t              back_ = 0;
+    uint8_t              front_ = 1;
+    std::atomic<uint8_t> state_ = 2;    // the middle slot, and whether it was published since the last read
+};
+
+#endif //TRIPLE_BUFFER_HH
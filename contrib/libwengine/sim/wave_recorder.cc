@@ -0,0 +1,481 @@
+#include "wave_recorder.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+static constexpr char HEADER_MAGIC[8] = { 'W', 'T', 'W', 'A', 'V', 'E', 'S', '1' };
+static constexpr char FOOTER_MAGIC[8] = { 'W', 'T', 'W', 'A', 'V', 'E', 'N', 'D' };
+static constexpr size_t CHUNK_HEADER_SIZE = 24;
+
+//
+// ENCODING
+//
+
+static void put_uint(std::vector<uint8_t>& out, uint64_t v, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+        out.push_back((uint8_t) (v >> (i * 8)));
+}
+
+static uint64_t get_uint(uint8_t const* p, size_t bytes)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        v |= uint64_t(p[i]) << (i * 8);
+    return v;
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t) v);
+}
+
+static uint64_t get_varint(uint8_t const*& p, uint8_t const* end)
+{
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    return v;
+}
+
+static void write_all(std::FILE* f, std::vector<uint8_t> const& data)
+{
+    if (!data.empty() && std::fwrite(data.data(), 1, data.size(), f) != data.size())
+        throw std::runtime_error("Error writing waveform file");
+}
+
+//
+// SETUP
+//
+
+WaveRecorder::WaveRecorder(Netlist const& netlist)
+    : netlist_(netlist), ring_(RING_CAPACITY)
+{
+}
+
+WaveRecorder::~WaveRecorder()
+{
+    try {
+        stop();
+    } catch (std::exception&) {
+    }
+}
+
+void WaveRecorder::watch(WireId w, std::string const& name)
+{
+    if (recording_)
+        throw std::logic_error("Signals can't be changed while recording");
+    if (w >= netlist_.wire_count())
+        throw std::out_of_range("Invalid wire " + std::to_string(w));
+    signals_.push_back({ w, name.empty() ? "w" + std::to_string(w) : name });
+    watch_limit_ = std::max(watch_limit_, w + 1);
+}
+
+void WaveRecorder::unwatch_all()
+{
+    if (recording_)
+        throw std::logic_error("Signals can't be changed while recording");
+    signals_.clear();
+    watch_limit_ = 0;
+}
+
+void WaveRecorder::start(std::string const& path)
+{
+    if (recording_)
+        throw std::logic_error("Already recording");
+    // the circuit may have changed since the signals were watched
+    for (Signal const& s : signals_)
+        if (s.wire >= netlist_.wire_count())
+            throw std::out_of_range("The watched wire " + std::to_string(s.wire) + " (" + s.name + ") no longer exists");
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_)
+        throw std::runtime_error("Could not open '" + path + "' for writing");
+
+    std::vector<uint8_t> header(HEADER_MAGIC, HEADER_MAGIC + sizeof HEADER_MAGIC);
+    put_uint(header, signals_.size(), 4);
+    try {
+        write_all(file_, header);
+    } catch (...) {
+        std::fclose(std::exchange(file_, nullptr));
+        throw;
+    }
+
+    path_ = path;
+    last_.assign(signals_.size(), 0);
+    current_.assign(signals_.size(), 0);
+    first_sample_ = true;
+    buffer_.clear();
+    index_.clear();
+    stop_requested_ = flush_requested_ = false;
+    error_.clear();
+    transitions_ = stalls_ = 0;
+    bytes_ = header.size();
+
+    recording_ = true;
+    thread_ = std::thread([this] { writer(); });
+}
+
+void WaveRecorder::stop()
+{
+    if (!recording_)
+        return;
+
+    {
+        std::lock_guard lock(mutex_);
+        stop_requested_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    std::fclose(file_);
+    file_ = nullptr;
+    recording_ = false;
+
+    if (!error_.empty())
+        throw std::runtime_error(std::exchange(error_, {}));
+}
+
+void WaveRecorder::flush()
+{
+    if (!recording_)
+        return;
+
+    std::unique_lock lock(mutex_);
+    flush_requested_ = true;
+    wake_.notify_one();
+    flushed_.wait(lock, [this] { return !flush_requested_; });
+}
+
+//
+// SIMULATION THREAD
+//
+
+void WaveRecorder::sample(uint64_t tick)
+{
+    if (!recording_)
+        return;
+
+    for (uint32_t i = 0; i < signals_.size(); ++i) {
+        uint8_t v = netlist_.value(signals_[i].wire);
+        if (v == last_[i] && !first_sample_)
+            continue;
+        last_[i] = v;
+
+        Record r { tick, i, v };
+        while (!ring_.push(r)) {
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+            wake_.notify_one();
+            std::this_thread::yield();
+        }
+        transitions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    first_sample_ = false;
+
+    if (ring_.size() > ring_.capacity() / 2)
+        wake_.notify_one();
+}
+
+//
+// WRITER THREAD
+//
+
+void WaveRecorder::writer()
+{
+    // after a write error the transitions are still drained, so the simulation never blocks, but dropped
+    bool failed = false;
+    auto encode_all = [&] {
+        ring_.drain([&](Record const& r) {
+            if (failed)
+                return;
+            try {
+                encode(r);
+            } catch (std::exception& e) {
+                std::lock_guard lock(mutex_);
+                error_ = e.what();
+                failed = true;
+            }
+        });
+    };
+
+    for (;;) {
+        bool flush, stop;
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(10), [this] {
+                return stop_requested_ || flush_requested_ || ring_.size() > ring_.capacity() / 2;
+            });
+            flush = flush_requested_;
+            stop = stop_requested_;
+        }
+
+        encode_all();
+        if (!flush && !stop)
+            continue;
+
+        try {
+            if (!failed)
+                write_chunk();
+            if (stop && !failed)
+                write_footer();
+        } catch (std::exception& e) {
+            std::lock_guard lock(mutex_);
+            error_ = e.what();
+            failed = true;
+        }
+
+        if (stop) {
+            std::lock_guard lock(mutex_);
+            if (flush_requested_) {
+                flush_requested_ = false;
+                flushed_.notify_all();
+            }
+            return;
+        }
+
+        std::lock_guard lock(mutex_);
+        flush_requested_ = false;
+        flushed_.notify_all();
+    }
+}
+
+void WaveRecorder::encode(Record const& r)
+{
+    if (buffer_.empty()) {
+        chunk_first_ = chunk_last_ = r.tick;
+        chunk_transitions_ = 0;
+        snapshot_.assign((current_.size() + 7) / 8, 0);
+        for (size_t i = 0; i < current_.size(); ++i)
+            snapshot_[i / 8] |= (uint8_t) (current_[i] << (i % 8));
+    }
+
+    put_varint(buffer_, r.tick - chunk_last_);
+    put_varint(buffer_, uint64_t(r.signal) << 1 | r.value);
+    chunk_last_ = r.tick;
+    current_[r.signal] = (uint8_t) r.value;
+    ++chunk_transitions_;
+
+    if (buffer_.size() >= CHUNK_BYTES)
+        write_chunk();
+}
+
+void WaveRecorder::write_chunk()
+{
+    if (buffer_.empty())
+        return;
+
+    Chunk chunk { chunk_first_, chunk_last_, (uint64_t) std::ftell(file_), (uint32_t) buffer_.size(), chunk_transitions_ };
+
+    std::vector<uint8_t> header;
+    put_uint(header, chunk.first_tick, 8);
+    put_uint(header, chunk.last_tick, 8);
+    put_uint(header, chunk.transitions, 4);
+    put_uint(header, chunk.size, 4);
+    write_all(file_, header);
+    write_all(file_, snapshot_);
+    write_all(file_, buffer_);
+    std::fflush(file_);
+
+    bytes_ += header.size() + snapshot_.size() + buffer_.size();
+    buffer_.clear();
+
+    std::lock_guard lock(mutex_);
+    index_.push_back(chunk);
+}
+
+// signal table and chunk index, followed by their offset, so the file can be read without scanning it
+void WaveRecorder::write_footer()
+{
+    uint64_t offset = (uint64_t) std::ftell(file_);
+
+    std::vector<uint8_t> footer;
+    put_uint(footer, signals_.size(), 4);
+    for (Signal const& s : signals_) {
+        put_uint(footer, s.wire, 4);
+        put_uint(footer, s.name.size(), 4);
+        footer.insert(footer.end(), s.name.begin(), s.name.end());
+    }
+    put_uint(footer, index_.size(), 4);
+    for (Chunk const& c : index_) {
+        put_uint(footer, c.first_tick, 8);
+        put_uint(footer, c.last_tick, 8);
+        put_uint(footer, c.offset, 8);
+        put_uint(footer, c.size, 4);
+        put_uint(footer, c.transitions, 4);
+    }
+    put_uint(footer, offset, 8);
+    footer.insert(footer.end(), FOOTER_MAGIC, FOOTER_MAGIC + sizeof FOOTER_MAGIC);
+    write_all(file_, footer);
+    std::fflush(file_);
+    bytes_ += footer.size();
+}
+
+//
+// READING
+//
+
+// `values` is set to the chunk snapshot, then updated after each on_transition(tick, signal, value) call
+template <typename F>
+void WaveRecorder::read_chunk(std::FILE* f, Chunk const& chunk, std::vector<uint8_t>& values, F on_transition) const
+{
+    size_t snapshot_size = (signals_.size() + 7) / 8;
+    std::vector<uint8_t> data(snapshot_size + chunk.size);
+    if (std::fseek(f, (long) (chunk.offset + CHUNK_HEADER_SIZE), SEEK_SET) != 0 || std::fread(data.data(), 1, data.size(), f) != data.size())
+        throw std::runtime_error("Error reading waveform file '" + path_ + "'");
+
+    values.resize(signals_.size());
+    for (size_t i = 0; i < signals_.size(); ++i)
+        values[i] = (data[i / 8] >> (i % 8)) & 1;
+
+    uint8_t const* p = data.data() + snapshot_size;
+    uint8_t const* end = data.data() + data.size();
+    uint64_t tick = chunk.first_tick;
+    while (p < end) {
+        tick += get_varint(p, end);
+        uint64_t sv = get_varint(p, end);
+        uint32_t signal = (uint32_t) (sv >> 1);
+        if (signal >= values.size())
+            throw std::runtime_error("Corrupt waveform file '" + path_ + "'");
+        on_transition(tick, signal, (bool) (sv & 1));
+        values[signal] = sv & 1;
+    }
+}
+
+std::vector<WaveRecorder::Transition> WaveRecorder::window(uint64_t start, uint64_t end) const
+{
+    std::vector<Chunk> index;
+    {
+        std::lock_guard lock(mutex_);
+        index = index_;
+    }
+    std::vector<Transition> result;
+    if (index.empty() || start > end)
+        return result;
+
+    std::FILE* f = std::fopen(path_.c_str(), "rb");
+    if (!f)
+        throw std::runtime_error("Could not open '" + path_ + "'");
+
+    // first chunk that reaches `start` (or the last one, for the values after the recording ends)
+    auto it = std::lower_bound(index.begin(), index.end(), start, [](Chunk const& c, uint64_t t) { return c.last_tick < t; });
+    if (it == index.end())
+        --it;
+
+    std::vector<uint8_t> values;
+    bool started = false;
+    auto emit_start = [&] {
+        for (size_t i = 0; i < signals_.size(); ++i)
+            result.push_back({ start, signals_[i].wire, (bool) values[i] });
+        started = true;
+    };
+
+    try {
+        // the first chunk is always read, for its snapshot, even if the window falls before it
+        for (auto first = it; it != index.end() && (it == first || it->first_tick <= end); ++it) {
+            read_chunk(f, *it, values, [&](uint64_t tick, uint32_t signal, bool value) {
+                if (tick <= start)
+                    return;
+                if (!started)
+                    emit_start();
+                if (tick <= end)
+                    result.push_back({ tick, signals_[signal].wire, value });
+            });
+        }
+        if (!started)
+            emit_start();
+    } catch (...) {
+        std::fclose(f);
+        throw;
+    }
+
+    std::fclose(f);
+    return result;
+}
+
+//
+// EXPORT
+//
+
+static std::string vcd_identifier(size_t i)
+{
+    std::string id;
+    do {
+        id += (char) ('!' + i % 94);
+        i /= 94;
+    } while (i > 0);
+    return id;
+}
+
+void WaveRecorder::export_vcd(std::string const& path) const
+{
+    std::vector<Chunk> index;
+    {
+        std::lock_guard lock(mutex_);
+        index = index_;
+    }
+
+    std::FILE* in = std::fopen(path_.c_str(), "rb");
+    if (!in)
+        throw std::runtime_error("Could not open '" + path_ + "'");
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        std::fclose(in);
+        throw std::runtime_error("Could not open '" + path + "' for writing");
+    }
+
+    std::fprintf(out, "$timescale 1ns $end\n$scope module circuit $end\n");
+    for (size_t i = 0; i < signals_.size(); ++i) {
+        std::string name = signals_[i].name;
+        std::replace(name.begin(), name.end(), ' ', '_');
+        std::fprintf(out, "$var wire 1 %s %s $end\n", vcd_identifier(i).c_str(), name.c_str());
+    }
+    std::fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+
+    // ticks are in order, so a new "#tick" line is only needed when the tick changes
+    std::vector<uint8_t> values;
+    uint64_t current = UINT64_MAX;
+    try {
+        for (Chunk const& chunk : index) {
+            read_chunk(in, chunk, values, [&](uint64_t tick, uint32_t signal, bool value) {
+                if (tick != current) {
+                    std::fprintf(out, "#%llu\n", (unsigned long long) tick);
+                    current = tick;
+                }
+                std::fprintf(out, "%c%s\n", value ? '1' : '0', vcd_identifier(signal).c_str());
+            });
+        }
+    } catch (...) {
+        std::fclose(in);
+        std::fclose(out);
+        throw;
+    }
+
+    std::fclose(in);
+    if (std::fclose(out) != 0)
+        throw std::runtime_error("Error writing '" + path + "'");
+}
+
+WaveRecorder::Stats WaveRecorder::stats() const
+{
+    Stats st;
+    st.signals = signals_.size();
+    st.transitions = transitions_;
+    st.stalls = stalls_;
+    st.bytes = bytes_;
+    st.pending = ring_.size();
+    st.recording = recording_;
+    std::lock_guard lock(mutex_);
+    st.chunks = index_.size();
+    return st;
+}
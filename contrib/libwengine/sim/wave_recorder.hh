@@ -0,0 +1,133 @@
+#ifndef WAVE_RECORDER_HH
+#define WAVE_RECORDER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "netlist.hh"
+#include "spsc_ring.hh"
+
+//
+// Records the transitions of selected wires while the simulation runs. The simulation thread only compares
+// the watched wires with their previous values and pushes the changes into a lock-free ring; a background
+// thread delta-encodes them (varint tick delta, varint signal/value) into chunks of about CHUNK_BYTES and
+// streams them to disk. Each chunk starts with the values of every signal, so a time window can be read back
+// by decoding only the chunks that cover it, found through an in-memory index. The index and the signal
+// names are also written at the end of the file when recording stops.
+//
+// Only one thread may call `sample` (the one running the simulation). If the writer falls behind and the
+// ring fills up, `sample` waits for it, and the wait is counted in the stats.
+//
+
+class WaveRecorder {
+public:
+    static constexpr size_t CHUNK_BYTES = 64 * 1024;
+    static constexpr size_t RING_CAPACITY = 1 << 20;   // transitions
+
+    struct Transition {
+        uint64_t tick;
+        WireId   wire;
+        bool     value;
+    };
+
+    struct Stats {
+        size_t   signals = 0;
+        uint64_t transitions = 0;
+        size_t   chunks = 0;
+        uint64_t bytes = 0;      // written to disk
+        uint64_t stalls = 0;     // times the simulation waited for the writer
+        size_t   pending = 0;    // transitions in the ring
+        bool     recording = false;
+    };
+
+    explicit WaveRecorder(Netlist const& netlist);
+    WaveRecorder(WaveRecorder const&) = delete;
+    WaveRecorder& operator=(WaveRecorder const&) = delete;
+    ~WaveRecorder();
+
+    // the watched signals can only be changed while not recording
+    void   watch(WireId w, std::string const& name = "");
+    void   unwatch_all();
+    WireId watch_limit() const { return watch_limit_; }   // every watched wire is below this
+
+    void start(std::string const& path);
+    void stop();    // throws if writing the file failed
+    void flush();   // write everything recorded so far, so `window` and `export_vcd` see it
+    bool recording() const { return recording_; }
+
+    void sample(uint64_t tick);   // called by the simulation after every step
+
+    // written transitions with start <= tick <= end; every signal is first listed with its value at `start`
+    std::vector<Transition> window(uint64_t start, uint64_t end) const;
+    void                    export_vcd(std::string const& path) const;
+
+    Stats stats() const;
+
+private:
+    struct Record {
+        uint64_t tick;
+        uint32_t signal;
+        uint32_t value;
+    };
+
+    struct Signal {
+        WireId      wire;
+        std::string name;
+    };
+
+    struct Chunk {
+        uint64_t first_tick;
+        uint64_t last_tick;
+        uint64_t offset;        // of the chunk header in the file
+        uint32_t size;          // encoded transitions, in bytes
+        uint32_t transitions;
+    };
+
+    template <typename F> void read_chunk(std::FILE* f, Chunk const& chunk, std::vector<uint8_t>& values, F on_transition) const;
+
+    void writer();
+    void encode(Record const& r);
+    void write_chunk();
+    void write_footer();
+
+    Netlist const&      netlist_;
+    std::vector<Signal> signals_;
+    WireId              watch_limit_ = 0;
+    std::string         path_;
+    bool                recording_ = false;
+
+    // simulation thread
+    std::vector<uint8_t> last_;
+    bool                 first_sample_ = true;
+    SpscRing<Record>     ring_;
+
+    // writer thread
+    std::thread          thread_;
+    std::FILE*           file_ = nullptr;
+    std::vector<uint8_t> current_;      // signal values after the last encoded transition
+    std::vector<uint8_t> snapshot_;     // packed values at the start of the open chunk
+    std::vector<uint8_t> buffer_;       // open chunk
+    uint64_t             chunk_first_ = 0;
+    uint64_t             chunk_last_ = 0;
+    uint32_t             chunk_transitions_ = 0;
+
+    // shared
+    mutable std::mutex      mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    std::vector<Chunk>      index_;
+    bool                    stop_requested_ = false;
+    bool                    flush_requested_ = false;
+    std::string             error_;
+    std::atomic<uint64_t>   transitions_ = 0;
+    std::atomic<uint64_t>   stalls_ = 0;
+    std::atomic<uint64_t>   bytes_ = 0;
+};
+
+#endif //WAVE_RECORDER_HH
@@ -0,0 +1,104 @@
+#include "wave_recorder_lua.hh"
+
+#include <string>
+
+#include "luaw/luaw.hh"
+#include "wave_recorder.hh"
+
+static WaveRecorder* self(lua_State* L)
+{
+    WaveRecorder* recorder = nullptr;
+    luaw_protect(L, [&] { recorder = luaw_to<WaveRecorder*>(L, 1); return 0; });
+    return recorder;
+}
+
+static int waves_watch(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->watch((WireId) luaL_checkinteger(L, 2), luaL_optstring(L, 3, ""));
+        return 0;
+    });
+}
+
+static int waves_clear(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->unwatch_all();
+        return 0;
+    });
+}
+
+static int waves_start(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->start(luaL_checkstring(L, 2));
+        return 0;
+    });
+}
+
+static int waves_stop(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->stop();
+        return 0;
+    });
+}
+
+static int waves_flush(lua_State* L)
+{
+    self(L)->flush();
+    return 0;
+}
+
+static int waves_window(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        auto transitions = self(L)->window((uint64_t) luaL_checknumber(L, 2), (uint64_t) luaL_checknumber(L, 3));
+        lua_createtable(L, (int) transitions.size(), 0);
+        for (size_t i = 0; i < transitions.size(); ++i) {
+            lua_createtable(L, 0, 3);
+            luaw_setfield(L, -1, "tick", transitions[i].tick);
+            luaw_setfield(L, -1, "wire", transitions[i].wire);
+            luaw_setfield(L, -1, "value", transitions[i].value);
+            lua_rawseti(L, -2, (int) i + 1);
+        }
+        return 1;
+    });
+}
+
+static int waves_export_vcd(lua_State* L)
+{
+    return luaw_protect(L, [&] {
+        self(L)->export_vcd(luaL_checkstring(L, 2));
+        return 0;
+    });
+}
+
+static int waves_stats(lua_State* L)
+{
+    auto st = self(L)->stats();
+    lua_newtable(L);
+    luaw_setfield(L, -1, "signals", st.signals);
+    luaw_setfield(L, -1, "transitions", st.transitions);
+    luaw_setfield(L, -1, "chunks", st.chunks);
+    luaw_setfield(L, -1, "bytes", st.bytes);
+    luaw_setfield(L, -1, "stalls", st.stalls);
+    luaw_setfield(L, -1, "pending", st.pending);
+    luaw_setfield(L, -1, "recording", st.recording);
+    return 1;
+}
+
+void wave_recorder_lua_install(lua_State* L, WaveRecorder* recorder)
+{
+    luaw_set_metatable<WaveRecorder>(L, {
+        { "watch",      waves_watch },
+        { "clear",      waves_clear },
+        { "start",      waves_start },
+        { "stop",       waves_stop },
+        { "flush",      waves_flush },
+        { "window",     waves_window },
+        { "export_vcd", waves_export_vcd },
+        { "stats",      waves_stats },
+    });
+    luaw_setglobal(L, "waves", recorder);
+}
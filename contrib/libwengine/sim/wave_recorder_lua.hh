@@ -0,0 +1,19 @@
+#ifndef WAVE_RECORDER_LUA_HH
+#define WAVE_RECORDER_LUA_HH
+
+#include <lua.hpp>
+
+class WaveRecorder;
+
+// Creates the global `waves`, the recorder of signal transitions of the native simulation:
+//
+//   waves:watch(wire, [name])          -- only while not recording
+//   waves:clear()                      -- forget the watched wires
+//   waves:start(path), waves:stop()
+//   waves:flush()                      -- make everything recorded so far readable
+//   waves:window(start, end)           -> { { tick=, wire=, value= }... }, starting with every wire's value at `start`
+//   waves:export_vcd(path)
+//   waves:stats()                      -> { signals=, transitions=, chunks=, bytes=, stalls=, pending=, recording= }
+void wave_recorder_lua_install(lua_State* L, WaveRecorder* recorder);
+
+#endif //WAVE_RECORDER_LUA_HH
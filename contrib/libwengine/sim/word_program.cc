@@ -0,0 +1,133 @@
+#include "word_program.hh"
+
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define WORD_X86 1
+#endif
+
+//
+// KERNELS
+//
+
+static void run_scalar(WordProgram::Instruction const* prog, size_t n, uint64_t* v, size_t words)
+{
+    for (size_t i = 0; i < n; ++i) {
+        WordProgram::Instruction const& ins = prog[i];
+        uint64_t* out = v + ins.out;
+        uint64_t const* a = v + ins.a;
+        uint64_t const* b = v + ins.b;
+        switch (ins.op) {
+            case 0: for (size_t k = 0; k < words; ++k) out[k] = (a[k] & b[k]) ^ ins.invert; break;
+            case 1: for (size_t k = 0; k < words; ++k) out[k] = (a[k] | b[k]) ^ ins.invert; break;
+            default: for (size_t k = 0; k < words; ++k) out[k] = (a[k] ^ b[k]) ^ ins.invert; break;
+        }
+    }
+}
+
+#ifdef WORD_X86
+
+__attribute__((target("avx2")))
+static void run_avx2(WordProgram::Instruction const* prog, size_t n, uint64_t* v, size_t words)
+{
+    for (size_t i = 0; i < n; ++i) {
+        WordProgram::Instruction const& ins = prog[i];
+        __m256i* out = (__m256i *) (v + ins.out);
+        __m256i const* a = (__m256i const *) (v + ins.a);
+        __m256i const* b = (__m256i const *) (v + ins.b);
+        __m256i inv = _mm256_set1_epi64x((long long) ins.invert);
+        size_t n_vec = words / 4;
+        switch (ins.op) {
+            case 0:
+                for (size_t k = 0; k < n_vec; ++k)
+                    _mm256_storeu_si256(out + k, _mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256(a + k), _mm256_loadu_si256(b + k)), inv));
+                break;
+            case 1:
+                for (size_t k = 0; k < n_vec; ++k)
+                    _mm256_storeu_si256(out + k, _mm256_xor_si256(_mm256_or_si256(_mm256_loadu_si256(a + k), _mm256_loadu_si256(b + k)), inv));
+                break;
+            default:
+                for (size_t k = 0; k < n_vec; ++k)
+                    _mm256_storeu_si256(out + k, _mm256_xor_si256(_mm256_xor_si256(_mm256_loadu_si256(a + k), _mm256_loadu_si256(b + k)), inv));
+                break;
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void run_avx512(WordProgram::Instruction const* prog, size_t n, uint64_t* v, size_t words)
+{
+    for (size_t i = 0; i < n; ++i) {
+        WordProgram::Instruction const& ins = prog[i];
+        uint64_t* out = v + ins.out;
+        uint64_t const* a = v + ins.a;
+        uint64_t const* b = v + ins.b;
+        __m512i inv = _mm512_set1_epi64((long long) ins.invert);
+        switch (ins.op) {
+            case 0:
+                for (size_t k = 0; k < words; k += 8)
+                    _mm512_storeu_si512(out + k, _mm512_xor_si512(_mm512_and_si512(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k)), inv));
+                break;
+            case 1:
+                for (size_t k = 0; k < words; k += 8)
+                    _mm512_storeu_si512(out + k, _mm512_xor_si512(_mm512_or_si512(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k)), inv));
+                break;
+            default:
+                for (size_t k = 0; k < words; k += 8)
+                    _mm512_storeu_si512(out + k, _mm512_xor_si512(_mm512_xor_si512(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k)), inv));
+                break;
+        }
+    }
+}
+
+#endif
+
+//
+// PROGRAM
+//
+
+// translate the two-input truth tables into word operations
+void WordProgram::load(std::span<CompiledSimulator::Instruction const> program, size_t words)
+{
+    words_ = words;
+
+    kernel_ = Kernel::Scalar;
+#ifdef WORD_X86
+    __builtin_cpu_init();
+    if (words % 8 == 0 && __builtin_cpu_supports("avx512f"))
+        kernel_ = Kernel::AVX512;
+    else if (words % 4 == 0 && __builtin_cpu_supports("avx2"))
+        kernel_ = Kernel::AVX2;
+#endif
+
+    program_.clear();
+    program_.reserve(program.size());
+    for (auto const& ins : program) {
+        Instruction wi { ins.out * words, ins.a * words, ins.b * words, 0, 0 };
+        switch (ins.truth) {
+            case 0x8: wi.op = 0; break;
+            case 0x7: wi.op = 0; wi.invert = ~uint64_t(0); break;
+            case 0xE: wi.op = 1; break;
+            case 0x1: wi.op = 1; wi.invert = ~uint64_t(0); break;
+            case 0x6: wi.op = 2; break;
+            case 0x9: wi.op = 2; wi.invert = ~uint64_t(0); break;
+            default: throw std::logic_error("Unexpected truth table in compiled program");
+        }
+        program_.push_back(wi);
+    }
+}
+
+void WordProgram::run(uint64_t* values) const
+{
+    switch (kernel_) {
+#ifdef WORD_X86
+        case Kernel::AVX512: run_avx512(program_.data(), program_.size(), values, words_); break;
+        case Kernel::AVX2:   run_avx2(program_.data(), program_.size(), values, words_); break;
+#else
+        case Kernel::AVX512:
+        case Kernel::AVX2:
+#endif
+        case Kernel::Scalar: run_scalar(program_.data(), program_.size(), values, words_); break;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef WORD_PROGRAM_HH
+#define WORD_PROGRAM_HH
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "compiled_sim.hh"
+
+//
+// A compiled program translated to run over bit-parallel values: every wire is a run of `words` 64-bit
+// words, each bit an independent lane (an input vector, or an instance of a subcircuit), and each
+// instruction becomes a bitwise and/or/xor, possibly inverted. The inner loops use AVX-512 or AVX2 when
+// the CPU has them and the number of words allows, and plain 64-bit words otherwise.
+//
+// Wire w occupies words [w * words, (w+1) * words).
+//
+
+class WordProgram {
+public:
+    enum class Kernel { Scalar, AVX2, AVX512 };
+
+    void load(std::span<CompiledSimulator::Instruction const> program, size_t words);
+    void run(uint64_t* values) const;
+
+    size_t size() const   { return program_.size(); }
+    size_t words() const  { return words_; }
+    Kernel kernel() const { return kernel_; }
+
+    struct Instruction {
+        size_t   out;      // word offsets
+        size_t   a;
+        size_t   b;
+        uint8_t  op;       // 0 = and, 1 = or, 2 = xor
+        uint64_t invert;   // xored with the result
+    };
+
+private:
+    std::vector<Instruction> program_;
+    size_t                   words_ = 0;
+    Kernel                   kernel_ = Kernel::Scalar;
+};
+
+#endif //WORD_PROGRAM_HH
@@ -1 +1,89 @@
 #include "wengine.hh"
+
+#include <raylib.h>
+
+#include "render/canvas_lua.hh"
+#include "render/renderer.hh"
+#include "sim/design_file.hh"
+#include "sim/sim_thread_lua.hh"
+#include "sim/simulation_lua.hh"
+#include "sim/switch_sim_lua.hh"
+#include "sim/wave_recorder_lua.hh"
+
+WEngine::WEngine()
+{
+    simulation.set_recorder(&recorder);
+    lua.with_lua([this](lua_State* L) {
+        modules.install(L);
+        scheduler.install(L);
+        simulation_lua_install(L, &simulation);
+        sim_thread_lua_install(L, &sim_thread);
+        switch_sim_lua_install(L, &switches);
+        wave_recorder_lua_install(L, &recorder);
+        canvas_lua_install(L, &canvas);
+    });
+}
+
+WEngine::~WEngine() = default;   // here, where Renderer is complete
+
+void WEngine::step()
+{
+    {
+        std::lock_guard lock(sim_mutex);
+        lua.with_lua([this](lua_State*) { scheduler.tick(); });
+    }
+    if (shards)
+        shards->step();
+}
+
+void WEngine::open_design(std::string const& path)
+{
+    std::lock_guard lock(sim_mutex);
+    ::open_design(simulation, path);
+}
+
+//
+// FRAME LOOP
+//
+
+// The window belongs to this thread, which renders from the latest snapshot published by the simulation
+// thread. Neither waits for the other: the simulation runs at its own rate, and the frames at 60 FPS.
+void WEngine::run(std::string const& title)
+{
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT);
+    InitWindow(1280, 720, title.c_str());
+    SetTargetFPS(60);
+    renderer_ = std::make_unique<Renderer>(canvas);
+
+    sim_thread.start();
+
+    while (!WindowShouldClose()) {
+        step();
+        renderer_->handle_input();
+
+        SimSnapshot const& snapshot = sim_thread.snapshot();
+        BeginDrawing();
+        ClearBackground(BLACK);
+        draw(snapshot);
+        EndDrawing();
+    }
+
+    sim_thread.stop();
+    renderer_.reset();
+    CloseWindow();
+}
+
+void WEngine::draw(SimSnapshot const& snapshot)
+{
+    renderer_->draw(snapshot);
+
+    static char const* levels[] = { "detail", "chunks", "blocks" };
+    Renderer::Stats const& st = renderer_->stats();
+    DrawText(TextFormat("tick %llu   %.0f ticks/s   %d FPS", (unsigned long long) snapshot.tick, snapshot.ticks_per_second, GetFPS()),
+             10, 10, 20, RAYWHITE);
+    DrawText(TextFormat("zoom %.3f (%s)   %zu items   %zu batches   %zu chunks pending", renderer_->camera().zoom,
+                        levels[(int) st.level], st.items, st.batches, st.chunks_pending),
+             10, 34, 10, RAYWHITE);
+    if (!snapshot.error.empty())
+        DrawText(snapshot.error.c_str(), 10, 50, 20, RED);
+}
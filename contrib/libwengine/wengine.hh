@@ -1,11 +1,50 @@
 #ifndef ENGINE_WENGINE_HH
 #define ENGINE_WENGINE_HH
 
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include "luaenv/lua.hh"
+#include "luaenv/modules.hh"
+#include "luaenv/scheduler.hh"
+#include "luaenv/shards.hh"
+#include "render/canvas.hh"
+#include "sim/sim_thread.hh"
+#include "sim/simulation.hh"
+#include "sim/switch_sim.hh"
+#include "sim/wave_recorder.hh"
+
+class Renderer;
 
 class WEngine {
 public:
-    Lua lua;
+    WEngine();
+    ~WEngine();
+
+    void run(std::string const& title);   // opens the window and runs the frame loop until it's closed
+    void step();    // advance scheduled C++ tasks and Lua coroutines (and the shards, if any) by one tick
+
+    void open_design(std::string const& path);   // maps a design file as the (empty) simulation, see design_file.hh
+    void enable_shards(size_t n_shards) { shards = std::make_unique<LuaShards>(n_shards, &modules); }
+
+    ModuleIndex                modules;     // what `require` finds, in the main Lua state and in the shards
+    Lua                        lua;
+    Scheduler                  scheduler;   // only touch it (and the Lua state it uses) from within `lua.with_lua`
+    std::unique_ptr<LuaShards> shards;      // scripted components running in parallel, one Lua state per worker
+    Simulation                 simulation;  // native circuit, described from Lua through the `circuit` global
+    SwitchNetwork              switches;    // transistor-level circuit, through the `transistors` global
+    WaveRecorder               recorder { simulation.netlist };   // transitions of the simulation, through `waves`
+    Canvas                     canvas;      // what the window shows, through the `canvas` global
+
+    // while `sim_thread` runs, the simulation (and so the Lua state) may only be touched holding `sim_mutex`
+    std::mutex                 sim_mutex;
+    SimThread                  sim_thread { simulation, sim_mutex };
+
+private:
+    void draw(SimSnapshot const& snapshot);
+
+    std::unique_ptr<Renderer>  renderer_;   // only while the window is open
 };
 
 
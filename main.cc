@@ -1,6 +1,137 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch.hh"
+#include "luaenv/modules.hh"
 #include "wengine.hh"
 
-int main()
+static int usage()
+{
+    fprintf(stderr, "usage: transistor [--batch [-j WORKERS] [-q QUEUE] [-f JOBLIST] [-o RESULTS] [-m MODULES]... [--check none|tag|full] [--no-affinity] [JOB...]]\n"
+                    "  JOB is CIRCUIT.lua[,TESTBENCH.lua]; JOBLIST has one job per line ('-' for stdin);\n"
+                    "  MODULES is a directory of Lua modules that scripts can require\n");
+    return 2;
+}
+
+static BatchRun::Job parse_job(std::string const& spec)
+{
+    size_t comma = spec.find(',');
+    if (comma == std::string::npos)
+        return { spec, "" };
+    return { spec.substr(0, comma), spec.substr(comma + 1) };
+}
+
+// a whole decimal number, without a sign
+static bool parse_count(char const* s, size_t& n)
+{
+    if (*s < '0' || *s > '9')
+        return false;
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > SIZE_MAX)
+        return false;
+    n = (size_t) value;
+    return true;
+}
+
+// Headless regression run: every job is a circuit script plus an optional testbench, see batch.hh. The exit
+// status is 0 if every job passed.
+static int batch_main(int argc, char* argv[])
 {
+    BatchOptions options;
+    ModuleIndex  modules;
+    std::string  job_list, results;
+    std::vector<std::string> jobs, module_dirs;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-j" && has_value) {
+            if (!parse_count(argv[++i], options.workers))
+                return usage();
+        } else if (arg == "-q" && has_value) {
+            if (!parse_count(argv[++i], options.queue))
+                return usage();
+        } else if (arg == "-f" && has_value)
+            job_list = argv[++i];
+        else if (arg == "-o" && has_value)
+            results = argv[++i];
+        else if (arg == "-m" && has_value)
+            module_dirs.push_back(argv[++i]);
+        else if (arg == "--check" && has_value) {
+            std::string check = argv[++i];
+            if (check == "none")
+                options.check = LuawCheck::None;
+            else if (check == "tag")
+                options.check = LuawCheck::Tag;
+            else if (check == "full")
+                options.check = LuawCheck::Full;
+            else
+                return usage();
+        } else if (arg == "--no-affinity")
+            options.affinity = false;
+        else if (arg.starts_with("-"))
+            return usage();
+        else
+            jobs.push_back(arg);
+    }
+    if (jobs.empty() && job_list.empty())
+        return usage();
+
+    try {
+        for (std::string const& dir : module_dirs)
+            modules.add_directory(dir);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+    options.modules = &modules;
+
+    std::ofstream results_file;
+    if (!results.empty()) {
+        results_file.open(results);
+        if (!results_file) {
+            fprintf(stderr, "Could not open '%s'\n", results.c_str());
+            return 2;
+        }
+    }
+    std::ifstream job_file;
+    if (!job_list.empty() && job_list != "-") {
+        job_file.open(job_list);
+        if (!job_file) {
+            fprintf(stderr, "Could not open '%s'\n", job_list.c_str());
+            return 2;
+        }
+    }
+
+    BatchRun run(options, results.empty() ? std::cout : results_file);
+    for (std::string const& job : jobs)
+        run.add(parse_job(job));
+    if (!job_list.empty()) {
+        // read as the jobs are taken, so the list can be of any size
+        std::istream& in = job_list == "-" ? std::cin : job_file;
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty() && line[0] != '#')
+                run.add(parse_job(line));
+    }
+
+    BatchRun::Summary summary = run.finish();
+    return summary.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+        return batch_main(argc - 2, argv + 2);
+
     WEngine W;
-}
\ No newline at end of file
+    W.run("transistor " PROJECT_VERSION);
+}